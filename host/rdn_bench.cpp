@@ -0,0 +1,474 @@
+// Headless driver for the reaction-diffusion engine.  Runs a model for a number of steps,
+// renders frames the same way RdnRenderer does, and reports throughput.
+//
+//     rdn_bench -m gs -s 360x640 -n 500 -p 0
+//
+// Optionally writes the last frame as a PPM so the output can be eyeballed.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "rdn_engine.h"
+#include "simd.h"
+
+struct ModelInfo {
+    const char *name;
+    int fn_idx;
+    int num_params;
+    float default_params[8];
+};
+
+// Defaults are the first preset of each function in res/values/arrays.xml.
+static const ModelInfo models[] = {
+    { "gl", 0, 3, { 2.0f, -0.816f, 4.068f } },
+    { "gs", 1, 3, { 0.1f, 0.01f, 0.047f } },
+    { "glq", 2, 3, { 1.5f, -1.6f, 1.1f } },
+    { "ws", 3, 5, { 2.0f, 0.02f, 0.05f, 1.21f, 8.0f } },
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -m model      gl (Ginzburg-Landau), gs (Gray-Scott), glq (quaternion\n"
+        "                Ginzburg-Landau) or ws (Wacker-Scholl) [gs]\n"
+        "  -s WxH        grid size, as passed to a single renderFrame() [256x256]\n"
+        "  -n steps      number of evolve() calls [200]\n"
+        "  -f frames     number of frames to render [same as steps]\n"
+        "  -p palette    palette index [0]\n"
+        "  -P a,b,c      model parameters [first preset]\n"
+        "  -S seed       random seed for the initial grid [1]\n"
+        "  -d solver     diffusion solver: explicit, implicit [explicit]\n"
+        "  -a tol        adaptive time stepping with this error tolerance [0: fixed step]\n"
+        "  -g topology   klein, torus, neumann [klein]\n"
+        "  -l 5|9        points of the Laplacian stencil [5]\n"
+        "  -t threads    number of engine threads [1]\n"
+        "  -x isa        kernels to use: scalar, sse2, avx2, neon [best available]\n"
+        "  -T 0|1        temporal blocking [0]\n"
+        "  -q format     state storage: float, fp16, int16 [float]\n"
+        "  -e eps        skip tiles within eps of the background [0: step everything]\n"
+        "  -w time[,sec] fast-forward by this much model time (see rdn_warm_up), within\n"
+        "                sec seconds [no limit], before stepping\n"
+        "  -F format     pixel format: rgb24, rgba8888, rgb565 [rgb24]\n"
+        "  -r rate       step on the simulation thread at this many steps/s (0: flat out)\n"
+        "                while rendering the frames, instead of stepping first\n"
+        "  -c            compare the final state against a run with reference settings\n"
+        "                (one thread, no temporal blocking, float storage, no sparse\n"
+        "                stepping)\n"
+        "  -v            print the engine's per-phase timings (see rdn_get_stats)\n"
+        "  -o file.ppm   write the last frame\n",
+        argv0);
+}
+
+static bool parse_params(const char *s, std::vector<float> &out) {
+    out.clear();
+    while(*s) {
+        char *end;
+        float v = strtof(s, &end);
+        if(end == s) return false;
+        out.push_back(v);
+        s = end;
+        if(*s == ',') s++;
+    }
+    return !out.empty();
+}
+
+static const char *topology_names[RDN_TOPOLOGY_NUM_TOPOLOGIES] = {
+    "klein", "torus", "neumann"
+};
+
+static const char *phase_names[RDN_PHASE_NUM_PHASES] = {
+    "step", "diffusion", "reaction", "render", "gradient", "jni"
+};
+
+static const char *pixel_format_names[RDN_PIXEL_NUM_FORMATS] = {
+    "rgb24", "rgba8888", "rgb565"
+};
+
+// Writes w*h pixels of the given RdnPixelFormat, expanded to 8 bits per channel.
+static bool write_ppm(const char *fn, const uint8_t *pix, int w, int h, int format) {
+    std::vector<uint8_t> rgb(w*h*3);
+    for(int i=0; i<w*h; i++) {
+        uint8_t *d = &rgb[i*3];
+        if(format == RDN_PIXEL_RGBA8888) {
+            memcpy(d, pix + i*4, 3);
+        } else if(format == RDN_PIXEL_RGB565) {
+            uint16_t v;
+            memcpy(&v, pix + i*2, 2);
+            d[0] = (v >> 11) * 255 / 31;
+            d[1] = ((v >> 5) & 63) * 255 / 63;
+            d[2] = (v & 31) * 255 / 31;
+        } else {
+            memcpy(d, pix + i*3, 3);
+        }
+    }
+    FILE *fh = fopen(fn, "wb");
+    if(!fh) return false;
+    fprintf(fh, "P6\n%d %d\n255\n", w, h);
+    fwrite(&rgb[0], 3, w*h, fh);
+    fclose(fh);
+    return true;
+}
+
+// Engine options that are expected to change performance but not (beyond rounding, or
+// the precision of the storage format) the result.  Compare mode (-c) runs the reference
+// settings first and then these.
+struct EngineSettings {
+    EngineSettings() :
+        threads(1),
+        temporal_blocking(false),
+        storage_format(RDN_STORAGE_FLOAT),
+        sparse_threshold(0)
+    { }
+
+    int threads;
+    bool temporal_blocking;
+    int storage_format;
+    float sparse_threshold;
+};
+
+static const char *storage_format_names[RDN_STORAGE_NUM_FORMATS] = {
+    "float", "fp16", "int16"
+};
+
+static EngineSettings reference_settings() {
+    EngineSettings s;
+    s.temporal_blocking = false;
+    s.storage_format = RDN_STORAGE_FLOAT;
+    s.sparse_threshold = 0;
+    return s;
+}
+
+static void apply_settings(const EngineSettings &s) {
+    rdn_set_num_threads(s.threads);
+    rdn_set_temporal_blocking(s.temporal_blocking);
+    rdn_set_storage_format(s.storage_format);
+    rdn_set_sparse_threshold(s.sparse_threshold);
+}
+
+// Sets up the model and a freshly seeded w*h grid.  The grid is allocated by the first
+// renderFrame, as on the device.
+static void start_run(const ModelInfo *model, const std::vector<float> &params, int pal,
+    int w, int h, unsigned seed, int pixel_format, uint8_t *pix
+) {
+    rdn_set_params(model->fn_idx, &params[0], params.size(), pal);
+    rdn_render_frame(pix, w, h, 1, pixel_format, 0, 1, 0);
+    srand(seed);
+    rdn_reset_grid();
+}
+
+static void print_stats() {
+    RdnPhaseStats stats[RDN_PHASE_NUM_PHASES];
+    rdn_get_stats(stats);
+    printf("%-10s %8s %8s %8s %10s %8s\n", "phase", "mean ms", "p95 ms", "max ms", "MB", "samples");
+    for(int i=0; i<RDN_PHASE_NUM_PHASES; i++) {
+        const RdnPhaseStats &s = stats[i];
+        if(!s.samples) continue;
+        printf("%-10s %8.3f %8.3f %8.3f %10.2f %8d\n",
+            phase_names[i], s.mean_ms, s.p95_ms, s.max_ms, s.bytes * 1e-6, s.samples);
+    }
+}
+
+static std::vector<float> get_state() {
+    int w, h;
+    int n = rdn_get_state_size(&w, &h);
+    std::vector<float> ret(n*w*h);
+    if(n) rdn_get_state(&ret[0]);
+    return ret;
+}
+
+static void print_state_diff(const std::vector<float> &ref, const std::vector<float> &cur) {
+    int w, h;
+    int n = rdn_get_state_size(&w, &h);
+    for(int i=0; i<n; i++) {
+        double max_diff = 0;
+        double sum_sq = 0;
+        double ref_sq = 0;
+        for(int j=i*w*h; j<(i+1)*w*h; j++) {
+            double d = fabs((double)cur[j] - ref[j]);
+            if(!(d <= max_diff)) max_diff = d; // also catches NaN
+            sum_sq += d*d;
+            ref_sq += (double)ref[j]*ref[j];
+        }
+        printf("component %d: max |diff| %.3g, rms diff %.3g, rms value %.3g\n",
+            i, max_diff, sqrt(sum_sq/(w*h)), sqrt(ref_sq/(w*h)));
+    }
+}
+
+int main(int argc, char **argv) {
+    const ModelInfo *model = &models[1];
+    int w = 256, h = 256;
+    int steps = 200;
+    int frames = -1;
+    int pal = 0;
+    unsigned seed = 1;
+    int solver = RDN_DIFFUSION_EXPLICIT;
+    float time_tolerance = 0;
+    int topology = RDN_TOPOLOGY_KLEIN;
+    int laplacian = RDN_LAPLACIAN_5_POINT;
+    int pixel_format = RDN_PIXEL_RGB24;
+    EngineSettings settings;
+    bool compare = false;
+    bool verbose = false;
+    float sim_rate = -1;
+    float warm_up_time = 0;
+    float warm_up_budget = 1e9f;
+    const char *isa = NULL;
+    const char *ppm_fn = NULL;
+    std::vector<float> params;
+
+    int opt;
+    while((opt = getopt(argc, argv, "m:s:n:f:p:P:S:d:a:g:l:t:x:T:q:e:w:F:r:cvo:h")) != -1) {
+        switch(opt) {
+            case 'm':
+                model = NULL;
+                for(size_t i=0; i<sizeof(models)/sizeof(models[0]); i++) {
+                    if(!strcmp(optarg, models[i].name)) model = &models[i];
+                }
+                if(!model) {
+                    fprintf(stderr, "unknown model: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                if(sscanf(optarg, "%dx%d", &w, &h) != 2 || w < 32 || h < 32) {
+                    fprintf(stderr, "bad size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n': steps = atoi(optarg); break;
+            case 'f': frames = atoi(optarg); break;
+            case 'p': pal = atoi(optarg); break;
+            case 'P':
+                if(!parse_params(optarg, params)) {
+                    fprintf(stderr, "bad params: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'S': seed = strtoul(optarg, NULL, 0); break;
+            case 'd':
+                if(!strcmp(optarg, "explicit")) {
+                    solver = RDN_DIFFUSION_EXPLICIT;
+                } else if(!strcmp(optarg, "implicit")) {
+                    solver = RDN_DIFFUSION_IMPLICIT;
+                } else {
+                    fprintf(stderr, "unknown solver: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'a': time_tolerance = atof(optarg); break;
+            case 'g':
+                topology = -1;
+                for(int i=0; i<RDN_TOPOLOGY_NUM_TOPOLOGIES; i++) {
+                    if(!strcmp(optarg, topology_names[i])) topology = i;
+                }
+                if(topology < 0) {
+                    fprintf(stderr, "unknown topology: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                if(!strcmp(optarg, "5")) {
+                    laplacian = RDN_LAPLACIAN_5_POINT;
+                } else if(!strcmp(optarg, "9")) {
+                    laplacian = RDN_LAPLACIAN_9_POINT;
+                } else {
+                    fprintf(stderr, "unknown stencil: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't': settings.threads = atoi(optarg); break;
+            case 'T': settings.temporal_blocking = atoi(optarg) != 0; break;
+            case 'q':
+                settings.storage_format = -1;
+                for(int i=0; i<RDN_STORAGE_NUM_FORMATS; i++) {
+                    if(!strcmp(optarg, storage_format_names[i])) settings.storage_format = i;
+                }
+                if(settings.storage_format < 0) {
+                    fprintf(stderr, "unknown storage format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e': settings.sparse_threshold = atof(optarg); break;
+            case 'w': {
+                std::vector<float> v;
+                if(!parse_params(optarg, v) || v.empty() || v.size() > 2) {
+                    fprintf(stderr, "bad warm-up: %s\n", optarg);
+                    return 1;
+                }
+                warm_up_time = v[0];
+                if(v.size() > 1) warm_up_budget = v[1];
+                break;
+            }
+            case 'F':
+                pixel_format = -1;
+                for(int i=0; i<RDN_PIXEL_NUM_FORMATS; i++) {
+                    if(!strcmp(optarg, pixel_format_names[i])) pixel_format = i;
+                }
+                if(pixel_format < 0) {
+                    fprintf(stderr, "unknown pixel format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'r': sim_rate = atof(optarg); break;
+            case 'c': compare = true; break;
+            case 'v': verbose = true; break;
+            case 'x': isa = optarg; break;
+            case 'o': ppm_fn = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(frames < 0) frames = steps;
+    if(compare && sim_rate >= 0) {
+        fprintf(stderr, "-c needs a fixed number of steps, so can't be used with -r\n");
+        return 1;
+    }
+
+    if(isa) {
+        bool ok = false;
+        for(int i=0; i<SIMD_NUM_LEVELS; i++) {
+            if(!strcmp(isa, simd_level_name((SimdLevel)i))) {
+                ok = simd_set_level((SimdLevel)i);
+            }
+        }
+        if(!ok) {
+            fprintf(stderr, "kernels not available: %s\n", isa);
+            return 1;
+        }
+    }
+
+    if(params.empty()) {
+        params.assign(model->default_params, model->default_params + model->num_params);
+    }
+
+    // Identity, same as an unmodified android.graphics.ColorMatrix.
+    float cm[20] = {
+        1, 0, 0, 0, 0,
+        0, 1, 0, 0, 0,
+        0, 0, 1, 0, 0,
+        0, 0, 0, 1, 0,
+    };
+
+    rdn_set_color_matrix(cm, 20);
+    rdn_set_diffusion_solver(model->fn_idx, solver);
+    rdn_set_time_tolerance(model->fn_idx, time_tolerance);
+    rdn_set_topology(topology);
+    rdn_set_laplacian(laplacian);
+
+    // Like RdnRenderer, the pixel buffer holds two mirrored tiles stacked vertically.
+    int bpp = rdn_pixel_size(pixel_format);
+    std::vector<uint8_t> pixels(w * h * 2 * bpp);
+    uint8_t *pix_hi = &pixels[0];
+    uint8_t *pix_lo = &pixels[w * h * bpp];
+    const float acc[3] = { 0.0f, 1.0f, 0.0f };
+
+    std::vector<float> ref_state;
+    if(compare) {
+        apply_settings(reference_settings());
+        start_run(model, params, pal, w, h, seed, pixel_format, pix_lo);
+        if(warm_up_time > 0) rdn_warm_up(warm_up_time, warm_up_budget);
+        for(int i=0; i<steps; i++) {
+            rdn_evolve();
+        }
+        ref_state = get_state();
+    }
+
+    apply_settings(settings);
+    start_run(model, params, pal, w, h, seed, pixel_format, pix_lo);
+
+    float warm_up_covered = 0;
+    double warm_up_sec = 0;
+    if(warm_up_time > 0) {
+        double tw = now_sec();
+        warm_up_covered = rdn_warm_up(warm_up_time, warm_up_budget);
+        warm_up_sec = now_sec() - tw;
+    }
+
+    // With the simulation thread the steps overlap the rendering, and the number of steps
+    // is however many it got through in the meantime.
+    unsigned step_count0 = rdn_get_step_count();
+    rdn_reset_stats();
+    double t0 = now_sec();
+    if(sim_rate >= 0) {
+        rdn_start_simulation(sim_rate);
+    } else {
+        for(int i=0; i<steps; i++) {
+            rdn_evolve();
+        }
+    }
+    double t1 = now_sec();
+    for(int i=0; i<frames; i++) {
+        rdn_render_frame(pix_hi, w, h, 0, pixel_format, acc[0], acc[1], acc[2]);
+        rdn_render_frame(pix_lo, w, h, 1, pixel_format, acc[0], acc[1], acc[2]);
+    }
+    double t2 = now_sec();
+    if(sim_rate >= 0) {
+        rdn_stop_simulation();
+        steps = rdn_get_step_count() - step_count0;
+    }
+
+    double step_sec = sim_rate >= 0 ? t2 - t1 : t1 - t0;
+    double draw_sec = t2 - t1;
+    printf("model=%s grid=%dx%d palette=%d steps=%d frames=%d threads=%d isa=%s "
+        "storage=%s pixels=%s topology=%s laplacian=%d%s%s%s\n",
+        model->name, w, h, pal, steps, frames, rdn_get_num_threads(),
+        simd_level_name(simd_kernels().level),
+        storage_format_names[settings.storage_format],
+        pixel_format_names[pixel_format],
+        topology_names[topology],
+        laplacian == RDN_LAPLACIAN_9_POINT ? 9 : 5,
+        solver == RDN_DIFFUSION_IMPLICIT ? " implicit" : "",
+        settings.temporal_blocking ? " temporal" : "",
+        sim_rate >= 0 ? " sim-thread" : "");
+    if(warm_up_time > 0) {
+        printf("warm-up: %.4g of %.4g time units in %.1f ms\n",
+            warm_up_covered, warm_up_time, warm_up_sec * 1e3);
+    }
+    if(steps) {
+        printf("evolve: %8.2f steps/s  %8.3f ms/step  %7.2f ns/cell\n",
+            steps / step_sec, step_sec / steps * 1e3, step_sec / steps / (w*h) * 1e9);
+    }
+    if(frames) {
+        printf("render: %8.2f frames/s %8.3f ms/frame %7.2f ns/pixel\n",
+            frames / draw_sec, draw_sec / frames * 1e3, draw_sec / frames / (2*w*h) * 1e9);
+    }
+
+    if(steps) {
+        printf("change: %.3g rms over the last step, dt %.3g\n",
+            rdn_get_change_rate(), rdn_get_time_step());
+        if(settings.sparse_threshold > 0) {
+            int active, total;
+            rdn_get_activity(&active, &total);
+            printf("active: %d of %d tiles in the last step\n", active, total);
+        }
+    }
+
+    if(verbose) {
+        print_stats();
+    }
+
+    if(compare) {
+        print_state_diff(ref_state, get_state());
+    }
+
+    if(ppm_fn && !write_ppm(ppm_fn, &pixels[0], w, h*2, pixel_format)) {
+        fprintf(stderr, "could not write %s\n", ppm_fn);
+        return 1;
+    }
+
+    return 0;
+}
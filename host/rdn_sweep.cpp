@@ -0,0 +1,370 @@
+// Headless parameter sweep, for exploring presets before they go into
+// res/values/arrays.xml.  Runs a model from the same seed at every point of a grid of
+// parameter values, each on a small grid of its own, and writes a contact sheet of the
+// final frames plus a CSV of per-run statistics.
+//
+//     rdn_sweep -m gs -P 0.1,0.01:0.06:12,0.04:0.07:12 -o sheet.ppm -c runs.csv
+//
+// Each parameter is either a single value or lo:hi:count.  Points are numbered with the
+// last parameter varying fastest, and laid out on the sheet with one column per value of
+// the last varying parameter.
+//
+// The engine is a singleton, so runs are spread over worker processes rather than
+// threads; each worker takes the next point from a counter in shared memory.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "rdn_engine.h"
+
+struct ModelInfo {
+    const char *name;
+    int fn_idx;
+    int num_params;
+    float default_params[8];
+};
+
+// Same as in rdn_bench.cpp.
+static const ModelInfo models[] = {
+    { "gl", 0, 3, { 2.0f, -0.816f, 4.068f } },
+    { "gs", 1, 3, { 0.1f, 0.01f, 0.047f } },
+    { "glq", 2, 3, { 1.5f, -1.6f, 1.1f } },
+    { "ws", 3, 5, { 2.0f, 0.02f, 0.05f, 1.21f, 8.0f } },
+};
+
+#define MAX_COMPONENTS 4
+
+// Thresholds for the status column: a run whose components all have a spatial standard
+// deviation below DEAD_STDDEV has died out to a uniform state; one whose last steps
+// changed less than STATIC_CHANGE (see rdn_get_change_rate) has frozen.
+#define DEAD_STDDEV 1e-3f
+#define STATIC_CHANGE 1e-4f
+
+// Results of one run, written by a worker into shared memory.
+struct RunResult {
+    bool done;
+    float ms;
+    // Change rate of the last step, and its mean over the last quarter of the steps.
+    float change;
+    float mean_change;
+    int n;
+    float mean[MAX_COMPONENTS];
+    float stddev[MAX_COMPONENTS];
+};
+
+// Header of the shared memory block.  It is followed by the results of all points and
+// then their thumbnails.
+struct Shared {
+    volatile int next_point;
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -m model      gl (Ginzburg-Landau), gs (Gray-Scott), glq (quaternion\n"
+        "                Ginzburg-Landau) or ws (Wacker-Scholl) [gs]\n"
+        "  -P spec       parameters, each a value or lo:hi:count, comma separated\n"
+        "                [first preset]\n"
+        "  -s WxH        grid size of each run [96x96]\n"
+        "  -n steps      number of evolve() calls per run [500]\n"
+        "  -p palette    palette index [0]\n"
+        "  -S seed       random seed for the initial grid, the same for every run [1]\n"
+        "  -j jobs       number of worker processes [number of cores]\n"
+        "  -o file.ppm   write the contact sheet\n"
+        "  -c file.csv   write per-run statistics [stdout]\n",
+        argv0);
+}
+
+// One axis of the sweep: count values evenly spaced from lo to hi.
+struct Axis {
+    float lo, hi;
+    int count;
+
+    float value(int i) const {
+        return count > 1 ? lo + (hi - lo) * i / (count - 1) : lo;
+    }
+};
+
+static bool parse_axes(const char *s, std::vector<Axis> &out) {
+    out.clear();
+    while(*s) {
+        Axis a;
+        char *end;
+        a.lo = a.hi = strtof(s, &end);
+        a.count = 1;
+        if(end == s) return false;
+        s = end;
+        if(*s == ':') {
+            a.hi = strtof(s+1, &end);
+            if(end == s+1 || *end != ':') return false;
+            s = end + 1;
+            a.count = strtol(s, &end, 10);
+            if(end == s || a.count < 1) return false;
+            s = end;
+        }
+        out.push_back(a);
+        if(*s == ',') {
+            s++;
+        } else if(*s) {
+            return false;
+        }
+    }
+    return !out.empty();
+}
+
+// The parameters of point i.
+static std::vector<float> point_params(const std::vector<Axis> &axes, int i) {
+    std::vector<float> p(axes.size());
+    for(int j=axes.size()-1; j>=0; j--) {
+        p[j] = axes[j].value(i % axes[j].count);
+        i /= axes[j].count;
+    }
+    return p;
+}
+
+static void run_point(const ModelInfo *model, const std::vector<float> &params,
+    int pal, int w, int h, unsigned seed, int steps, RunResult &res, uint8_t *thumb
+) {
+    double t0 = now_sec();
+
+    rdn_set_params(model->fn_idx, &params[0], params.size(), pal);
+    // Allocates the grid, as on the device.
+    rdn_render_frame(thumb, w, h, 0, RDN_PIXEL_RGB24, 0, 1, 0);
+    srand(seed);
+    rdn_reset_grid();
+
+    double sum_change = 0;
+    int tail = std::max(steps / 4, 1);
+    for(int i=0; i<steps; i++) {
+        rdn_evolve();
+        if(i >= steps - tail) sum_change += rdn_get_change_rate();
+    }
+    rdn_render_frame(thumb, w, h, 0, RDN_PIXEL_RGB24, 0, 1, 0);
+
+    res.change = rdn_get_change_rate();
+    res.mean_change = sum_change / tail;
+
+    int gw, gh;
+    int n = rdn_get_state_size(&gw, &gh);
+    std::vector<float> state(n*gw*gh);
+    rdn_get_state(&state[0]);
+    res.n = std::min(n, MAX_COMPONENTS);
+    for(int i=0; i<res.n; i++) {
+        double sum = 0, sum_sq = 0;
+        for(int j=i*gw*gh; j<(i+1)*gw*gh; j++) {
+            sum += state[j];
+            sum_sq += (double)state[j]*state[j];
+        }
+        double mean = sum / (gw*gh);
+        res.mean[i] = mean;
+        res.stddev[i] = sqrt(std::max(0.0, sum_sq / (gw*gh) - mean*mean));
+    }
+
+    res.ms = (now_sec() - t0) * 1e3;
+    res.done = true;
+}
+
+static const char *run_status(const RunResult &r) {
+    if(!r.done) return "failed";
+    // Written so that NaN counts as active.
+    bool dead = true;
+    for(int i=0; i<r.n; i++) {
+        if(!(r.stddev[i] < DEAD_STDDEV)) dead = false;
+    }
+    if(dead) return "dead";
+    if(r.mean_change < STATIC_CHANGE) return "static";
+    return "active";
+}
+
+// Thumbnails in a grid of cols columns, separated by gap pixels of dark gray.
+static bool write_sheet(const char *fn, const uint8_t *thumbs, int num, int cols,
+    int w, int h
+) {
+    const int gap = 2;
+    int rows = (num + cols - 1) / cols;
+    int sw = cols * (w + gap) + gap;
+    int sh = rows * (h + gap) + gap;
+    std::vector<uint8_t> sheet(sw * sh * 3, 64);
+    for(int i=0; i<num; i++) {
+        int x0 = gap + (i % cols) * (w + gap);
+        int y0 = gap + (i / cols) * (h + gap);
+        for(int y=0; y<h; y++) {
+            memcpy(&sheet[((y0 + y) * sw + x0) * 3],
+                thumbs + (size_t)(i*h + y) * w * 3, w * 3);
+        }
+    }
+    FILE *fh = fopen(fn, "wb");
+    if(!fh) return false;
+    fprintf(fh, "P6\n%d %d\n255\n", sw, sh);
+    fwrite(&sheet[0], 3, sw*sh, fh);
+    fclose(fh);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const ModelInfo *model = &models[1];
+    int w = 96, h = 96;
+    int steps = 500;
+    int pal = 0;
+    unsigned seed = 1;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *sheet_fn = NULL;
+    const char *csv_fn = NULL;
+    std::vector<Axis> axes;
+
+    int opt;
+    while((opt = getopt(argc, argv, "m:P:s:n:p:S:j:o:c:h")) != -1) {
+        switch(opt) {
+            case 'm':
+                model = NULL;
+                for(size_t i=0; i<sizeof(models)/sizeof(models[0]); i++) {
+                    if(!strcmp(optarg, models[i].name)) model = &models[i];
+                }
+                if(!model) {
+                    fprintf(stderr, "unknown model: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if(!parse_axes(optarg, axes)) {
+                    fprintf(stderr, "bad params: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                if(sscanf(optarg, "%dx%d", &w, &h) != 2 || w < 32 || h < 32) {
+                    fprintf(stderr, "bad size: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n': steps = atoi(optarg); break;
+            case 'p': pal = atoi(optarg); break;
+            case 'S': seed = strtoul(optarg, NULL, 0); break;
+            case 'j': jobs = atoi(optarg); break;
+            case 'o': sheet_fn = optarg; break;
+            case 'c': csv_fn = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    jobs = std::max(jobs, 1);
+
+    if(axes.empty()) {
+        for(int i=0; i<model->num_params; i++) {
+            Axis a = { model->default_params[i], model->default_params[i], 1 };
+            axes.push_back(a);
+        }
+    }
+    if((int)axes.size() != model->num_params) {
+        fprintf(stderr, "model %s takes %d params\n", model->name, model->num_params);
+        return 1;
+    }
+
+    int num_points = 1;
+    int cols = 1;
+    for(size_t i=0; i<axes.size(); i++) {
+        num_points *= axes[i].count;
+        if(axes[i].count > 1) cols = axes[i].count;
+    }
+
+    // Everything the workers write goes into one shared anonymous mapping, made before
+    // forking.  The parent never touches the engine, so each worker starts from a fresh
+    // one.
+    size_t thumb_bytes = (size_t)w * h * 3;
+    size_t shared_bytes = sizeof(Shared) + num_points * (sizeof(RunResult) + thumb_bytes);
+    void *mem = mmap(NULL, shared_bytes, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    Shared *shared = (Shared *)mem;
+    RunResult *results = (RunResult *)(shared + 1);
+    uint8_t *thumbs = (uint8_t *)(results + num_points);
+
+    double t0 = now_sec();
+    std::vector<pid_t> workers;
+    for(int k=0; k<std::min(jobs, num_points); k++) {
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("fork");
+            break;
+        }
+        if(pid == 0) {
+            // Identity, same as an unmodified android.graphics.ColorMatrix.
+            float cm[20] = {
+                1, 0, 0, 0, 0,
+                0, 1, 0, 0, 0,
+                0, 0, 1, 0, 0,
+                0, 0, 0, 1, 0,
+            };
+            rdn_set_color_matrix(cm, 20);
+            rdn_set_num_threads(1);
+            for(;;) {
+                int i = __sync_fetch_and_add(&shared->next_point, 1);
+                if(i >= num_points) break;
+                run_point(model, point_params(axes, i), pal, w, h, seed, steps,
+                    results[i], thumbs + i * thumb_bytes);
+            }
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+    for(size_t k=0; k<workers.size(); k++) {
+        waitpid(workers[k], NULL, 0);
+    }
+    double t1 = now_sec();
+
+    FILE *csv = csv_fn ? fopen(csv_fn, "w") : stdout;
+    if(!csv) {
+        fprintf(stderr, "could not write %s\n", csv_fn);
+        return 1;
+    }
+    fprintf(csv, "index,row,col");
+    for(size_t j=0; j<axes.size(); j++) fprintf(csv, ",p%d", (int)j);
+    fprintf(csv, ",status,change,mean_change");
+    int n = 0;
+    for(int i=0; i<num_points; i++) n = std::max(n, results[i].n);
+    for(int c=0; c<n; c++) fprintf(csv, ",mean%d,stddev%d", c, c);
+    fprintf(csv, ",ms\n");
+    int active = 0;
+    for(int i=0; i<num_points; i++) {
+        const RunResult &r = results[i];
+        std::vector<float> p = point_params(axes, i);
+        fprintf(csv, "%d,%d,%d", i, i / cols, i % cols);
+        for(size_t j=0; j<p.size(); j++) fprintf(csv, ",%g", p[j]);
+        const char *status = run_status(r);
+        if(!strcmp(status, "active")) active++;
+        fprintf(csv, ",%s,%.4g,%.4g", status, r.change, r.mean_change);
+        for(int c=0; c<n; c++) fprintf(csv, ",%.4g,%.4g", r.mean[c], r.stddev[c]);
+        fprintf(csv, ",%.1f\n", r.ms);
+    }
+    if(csv != stdout) fclose(csv);
+
+    fprintf(stderr, "%d runs of %d steps at %dx%d in %.2f s with %d workers, %d active\n",
+        num_points, steps, w, h, t1 - t0, (int)workers.size(), active);
+
+    if(sheet_fn && !write_sheet(sheet_fn, thumbs, num_points, cols, w, h)) {
+        fprintf(stderr, "could not write %s\n", sheet_fn);
+        return 1;
+    }
+
+    return 0;
+}
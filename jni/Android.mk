@@ -3,11 +3,18 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_MODULE    := rdnlib
-LOCAL_SRC_FILES := rdnlib.cpp
-LOCAL_LDLIBS    := -lm -llog -ljnigraphics
+LOCAL_SRC_FILES := rdnlib.cpp rdn_engine.cpp state_file.cpp thread_pool.cpp simd.cpp
+LOCAL_LDLIBS    := -lm -llog
 LOCAL_CFLAGS    := -O3 -funroll-loops -Wall #-mfpu=vfpv3
 LOCAL_C_INCLUDES := eigen-android
 
+# NEON kernels are built separately and only used if the CPU has NEON (see simd.cpp).
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_SRC_FILES += simd_neon.cpp.neon
+LOCAL_CFLAGS += -DRDN_HAVE_NEON
+LOCAL_STATIC_LIBRARIES += cpufeatures
+endif
+
 #LOCAL_C_INCLUDES += /home/dstahlke/Desktop/android-ndk-profiler
 #LOCAL_CFLAGS += -pg
 #LOCAL_STATIC_LIBRARIES += android-ndk-profiler
@@ -15,3 +22,4 @@ LOCAL_C_INCLUDES := eigen-android
 include $(BUILD_SHARED_LIBRARY)
 
 #$(call import-module,android-ndk-profiler)
+$(call import-module,android/cpufeatures)
@@ -2,3 +2,4 @@
 #APP_ABI := armeabi-v7a x86 mips
 APP_ABI := armeabi-v7a x86 mips
 APP_PLATFORM := android-8
+APP_STL := gnustl_static
@@ -0,0 +1,58 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <time.h>
+
+#include <algorithm>
+
+// Monotonic time in seconds, for timing phases.
+static inline double perf_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Rolling statistics of one phase over its last WINDOW samples (one per step or frame),
+// and the number of bytes the last one touched.  Not thread safe.
+class PhaseStats {
+public:
+    enum { WINDOW = 128 };
+
+    PhaseStats() : num(0), next(0), bytes(0) { }
+
+    void add(float ms, float _bytes) {
+        samples[next] = ms;
+        next = (next + 1) % WINDOW;
+        if(num < WINDOW) num++;
+        bytes = _bytes;
+    }
+
+    void clear() {
+        num = next = 0;
+        bytes = 0;
+    }
+
+    int count() const { return num; }
+    float last_bytes() const { return bytes; }
+
+    // Mean, 95th percentile (nearest rank) and maximum; all 0 without samples.
+    void summarize(float &mean, float &p95, float &max) const {
+        mean = p95 = max = 0;
+        if(!num) return;
+        float sorted[WINDOW];
+        std::copy(samples, samples + num, sorted);
+        std::sort(sorted, sorted + num);
+        float sum = 0;
+        for(int i=0; i<num; i++) sum += sorted[i];
+        mean = sum / num;
+        p95 = sorted[(95*num + 99) / 100 - 1];
+        max = sorted[num-1];
+    }
+
+private:
+    float samples[WINDOW];
+    int num, next;
+    float bytes;
+};
+
+#endif // PERF_STATS_H
@@ -0,0 +1,3364 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+//#include <Eigen/SVD>
+
+//#include "prof.h"
+
+#include "rdn_log.h"
+#include "perf_stats.h"
+#include "rdn_engine.h"
+#include "simd.h"
+#include "state_file.h"
+#include "storage.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+
+float color_matrix[20];
+// Bumped by rdn_set_color_matrix() so palettes know to refold their colors.
+int color_matrix_serial = 0;
+
+ThreadPool pool;
+
+// Temporal blocking: step() advances tiles of rows through several diffusion substeps and
+// reactions while they are in cache, instead of sweeping the whole grid for each one.  A
+// tile and its halo should fit in TILE_BYTES (about a core's share of L2 on the devices we
+// ship on); MAX_TILE_HALO limits how many substeps are fused into one pass (each one eats
+// a row of halo on both sides).  Off by default until it has been measured on devices.
+bool temporal_blocking = false;
+#define TILE_BYTES (512*1024)
+#define MAX_TILE_HALO 16
+
+// Sparse stepping (see rdn_set_sparse_threshold): tiles of ACTIVE_TILE x ACTIVE_TILE cells
+// that have settled at the model's background state are skipped.  0 disables it.
+float sparse_threshold = 0;
+#define ACTIVE_TILE 32
+
+// Steady state detection (see rdn_set_steady_state).  The change per step is measured on
+// every PROBE_SPACING-th row.  While it is below steady_throttle the interval between
+// steps doubles, up to MAX_STEADY_SKIP skipped evolve() calls; STEADY_RESET_STEPS steps in
+// a row below steady_reset reset the grid.
+float steady_throttle = 0;
+float steady_reset = 0;
+#define PROBE_SPACING 16
+
+// Limits of the adaptive time step, relative to the model's fixed get_dt(), and the
+// number of times choose_dt() shrinks it before giving up.
+#define MIN_DT_DIVISOR 64
+#define MAX_DT_FACTOR 8
+#define MAX_DT_TRIES 8
+// Bound on the relative step doubling error of a perturbation (see reaction_error).  For
+// a mode decaying at rate l, an Euler step has relative error about (dt*l)^2 / 4, so this
+// keeps dt*l below 1, within the stability limit of 2.
+#define STIFF_LIMIT 0.25f
+#define MAX_STEADY_SKIP 15
+#define STEADY_RESET_STEPS 50
+int steady_skip_interval = 0;
+int steady_skip_left = 0;
+int steady_count = 0;
+
+// Warm-up after a reset (see rdn_set_warm_up).  Set when a new grid is seeded and by the
+// resets of rdn_reset_grid and evolve, and taken care of by the next evolve().
+float warm_up_time = 0;
+float warm_up_budget = 0;
+bool warm_up_pending = false;
+
+// Reaction steps per step(), each over the model's dt (see build_schedule).
+#define ITERATIONS_PER_STEP 5
+
+// One of RdnStorageFormat; the grid is converted by get_grids() when this changes.
+int storage_format = RDN_STORAGE_FLOAT;
+// One of RdnTopology; passed on to the grid by get_grids().
+int topology = RDN_TOPOLOGY_KLEIN;
+// One of RdnLaplacian; likewise.
+int laplacian = RDN_LAPLACIAN_5_POINT;
+
+#define vecn Eigen::Matrix<float, n, 1>
+#define matnn Eigen::Matrix<float, n, n>
+
+// Grids are stored planar (structure-of-arrays): one plane per component.  Each plane is
+// aligned to GRID_ALIGN bytes and rows are padded to a multiple of GRID_ALIGN so that every
+// row starts aligned and kernels can use full width vector loads per component.  The
+// padding leaves room for a ghost column on either side of each row (x = -1 and x = w),
+// which stencils read instead of wrapping around; see GridsN::fill_ghost_columns.
+#define GRID_ALIGN 32
+
+inline void *alloc_aligned(size_t bytes) {
+    // Over-allocate and stash the original pointer just before the aligned block, since
+    // posix_memalign isn't available on older Android platforms.
+    uint8_t *raw = (uint8_t *)malloc(bytes + GRID_ALIGN + sizeof(void *));
+    if(!raw) return NULL;
+    uintptr_t p = (uintptr_t)(raw + sizeof(void *));
+    p = (p + GRID_ALIGN - 1) & ~(uintptr_t)(GRID_ALIGN - 1);
+    ((void **)p)[-1] = raw;
+    return (void *)p;
+}
+
+inline void free_aligned(void *p) {
+    if(p) free(((void **)p)[-1]);
+}
+
+// A view of one row across all component planes.  Indexing gathers a vecn, so per-pixel
+// code can be written as if the grid were an array of vectors.
+template <int n>
+struct Row {
+    vecn operator[](int x) const {
+        vecn ret;
+        for(int i=0; i<n; i++) ret[i] = c[i][x];
+        return ret;
+    }
+
+    void set(int x, const vecn &v) const {
+        for(int i=0; i<n; i++) c[i][x] = v[i];
+    }
+
+    // The same row starting dx cells further along, for working on part of it.
+    Row<n> offset(int dx) const {
+        Row<n> ret;
+        for(int i=0; i<n; i++) ret.c[i] = c[i] + dx;
+        return ret;
+    }
+
+    float *c[n];
+};
+
+// T is float for everything the kernels touch; the compact state formats use uint16_t.
+template <int n, typename T = float>
+struct Grid {
+    Grid(int _w, int _h) :
+        w(_w), h(_h),
+        wh(w*h),
+        stride((w + 2 + PAD - 1) & ~(int)(PAD - 1)),
+        plane_size(stride*h)
+    {
+        // Rows start PAD elements into their stride, so the ghost columns of row y fall
+        // between the end of row y-1 and the start of row y+1.
+        mem = (T *)alloc_aligned((plane_size * n + PAD) * sizeof(T));
+        memset(mem, 0, (plane_size * n + PAD) * sizeof(T));
+        for(int i=0; i<n; i++) {
+            c[i] = mem + plane_size * i + PAD;
+        }
+    }
+
+    ~Grid() {
+        free_aligned(mem);
+    }
+
+    T *row(int comp, int y) { return c[comp] + y*stride; }
+
+    Row<n> get_row(int y) {
+        Row<n> ret;
+        for(int i=0; i<n; i++) ret.c[i] = row(i, y);
+        return ret;
+    }
+
+    const int w, h, wh;
+    // Distance in elements between rows, and between planes.  The planes are contiguous,
+    // so the whole grid is the n*plane_size elements from c[0].
+    const int stride, plane_size;
+    T *c[n];
+
+private:
+    Grid(const Grid &);
+    Grid &operator=(const Grid &);
+
+    enum { PAD = GRID_ALIGN / sizeof(T) };
+
+    T *mem;
+};
+
+// Filter taps for resampling a line of src_len cells to dst_len cells: dst cell i is the
+// sum over k in [start[i], start[i+1]) of weight[k] times src cell index[k].  The filter is
+// a tent as wide as a dst cell (two cells across, at least), so this is linear
+// interpolation when enlarging and a weighted average over the covered cells when
+// shrinking.  Past the ends the edge cells are repeated.
+struct ResampleTaps {
+    ResampleTaps(int src_len, int dst_len) {
+        float scale = (float)src_len / dst_len;
+        float radius = std::max(scale, 1.0f);
+        start.push_back(0);
+        for(int i=0; i<dst_len; i++) {
+            float center = (i + 0.5f) * scale - 0.5f;
+            int j0 = (int)ceilf(center - radius);
+            int j1 = (int)floorf(center + radius);
+            float sum = 0;
+            size_t first = weight.size();
+            for(int j=j0; j<=j1; j++) {
+                float wt = 1.0f - fabsf(j - center) / radius;
+                if(wt <= 0) continue;
+                index.push_back(std::min(std::max(j, 0), src_len-1));
+                weight.push_back(wt);
+                sum += wt;
+            }
+            for(size_t k=first; k<weight.size(); k++) weight[k] /= sum;
+            start.push_back(weight.size());
+        }
+    }
+
+    std::vector<int> start, index;
+    std::vector<float> weight;
+};
+
+// Backward Euler diffusion along a cyclic line of N points, i.e. solving
+//     x_i - M (x_{i-1} - 2 x_i + x_{i+1}) = d_i
+// for x, with M the diffusion matrix times the time step.  Unlike the explicit update this
+// is stable for any M, so a whole iteration's worth of diffusion can be taken at once.
+// The first N-1 unknowns are eliminated by block Thomas and expressed in terms of the last
+// one as x_i = y_i + Z_i x_{N-1}.  All the matrices depend only on M and N, so they are
+// computed once by prepare() and solve() is a few matrix-vector products per point.
+//
+// solve() works on SOLVER_LANES lines at once, which is what makes the recurrences
+// vectorizable.
+#define SOLVER_LANES 16
+
+template <int n>
+struct CyclicSolver {
+    CyclicSolver() : N(0) { }
+
+    void prepare(const float (&M_in)[n][n], int _N) {
+        if(_N == N && !memcmp(M_in, M_prev, sizeof(M_prev))) return;
+        N = _N;
+        memcpy(M_prev, M_in, sizeof(M_prev));
+
+        matnn M;
+        for(int i=0; i<n; i++) for(int j=0; j<n; j++) M(i, j) = M_in[i][j];
+        matnn B = matnn::Identity() + 2.0f * M;
+        matnn Cm = -M;
+        int m = N-1;
+        std::vector<matnn, Eigen::aligned_allocator<matnn> > Pm(m), cpm(m), Zm(m);
+        for(int i=0; i<m; i++) {
+            Pm[i] = (i ? matnn(B - Cm*cpm[i-1]) : B).inverse();
+            cpm[i] = Pm[i] * Cm;
+        }
+        // Z solves the same (non-cyclic) system, with -C as the right hand side in the
+        // first and last rows where the wraparound terms were dropped.
+        for(int i=0; i<m; i++) {
+            matnn r = matnn::Zero();
+            if(i == 0) r -= Cm;
+            if(i == m-1) r -= Cm;
+            if(i) r -= Cm * Zm[i-1];
+            Zm[i] = Pm[i] * r;
+        }
+        for(int i=m-2; i>=0; i--) Zm[i] -= cpm[i] * Zm[i+1];
+        matnn Sm = (B + Cm*Zm[m-1] + Cm*Zm[0]).inverse();
+
+        // The wraparound only reaches so far into the line: Z decays geometrically away
+        // from both ends and is negligible in the middle unless M is large.
+        z_head = 0;
+        while(z_head < m/2 && Zm[z_head].cwiseAbs().maxCoeff() > 1e-9f) z_head++;
+        z_tail = m;
+        while(z_tail > z_head && Zm[z_tail-1].cwiseAbs().maxCoeff() > 1e-9f) z_tail--;
+
+        P.resize(m*n*n);
+        cp.resize(m*n*n);
+        Z.resize(m*n*n);
+        for(int a=0; a<n; a++) for(int b=0; b<n; b++) {
+            for(int i=0; i<m; i++) {
+                P [(i*n+a)*n+b] = Pm [i](a, b);
+                cp[(i*n+a)*n+b] = cpm[i](a, b);
+                Z [(i*n+a)*n+b] = Zm [i](a, b);
+            }
+            C[a][b] = Cm(a, b);
+            S[a][b] = Sm(a, b);
+        }
+    }
+
+    // Solves SOLVER_LANES independent lines in place.  Point i of the lines is row i of
+    // work, one line per column; see GridsN::implicit_rows and implicit_columns.
+    void solve(Grid<n> &work) const {
+        int m = N-1;
+        float c[n][n];
+        memcpy(c, C, sizeof(c));
+
+        // Forward elimination: y_i = P_i (d_i - C y_{i-1})
+        for(int i=0; i<m; i++) {
+            float t[n][SOLVER_LANES];
+            load_lanes(work, i, t);
+            if(i) {
+                float yp[n][SOLVER_LANES];
+                load_lanes(work, i-1, yp);
+                mul_sub_lanes(c, yp, t);
+            }
+            float y[n][SOLVER_LANES];
+            mul_lanes(&P[i*n*n], t, y);
+            store_lanes(work, i, y);
+        }
+
+        // Back substitution: y_i -= cp_i y_{i+1}
+        for(int i=m-2; i>=0; i--) {
+            float y[n][SOLVER_LANES], yn[n][SOLVER_LANES];
+            load_lanes(work, i, y);
+            load_lanes(work, i+1, yn);
+            float k[n][n];
+            memcpy(k, &cp[i*n*n], sizeof(k));
+            mul_sub_lanes(k, yn, y);
+            store_lanes(work, i, y);
+        }
+
+        // The last unknown, from the last row with the wraparound terms.
+        float t[n][SOLVER_LANES], y0[n][SOLVER_LANES], ym[n][SOLVER_LANES];
+        load_lanes(work, m, t);
+        load_lanes(work, 0, y0);
+        load_lanes(work, m-1, ym);
+        mul_sub_lanes(c, y0, t);
+        mul_sub_lanes(c, ym, t);
+        float yl[n][SOLVER_LANES];
+        mul_lanes(&S[0][0], t, yl);
+        store_lanes(work, m, yl);
+
+        // x_i = y_i + Z_i x_{N-1}
+        for(int i=0; i<m; i++) {
+            if(i == z_head) i = z_tail;
+            if(i == m) break;
+            float y[n][SOLVER_LANES];
+            load_lanes(work, i, y);
+            float k[n][n];
+            for(int a=0; a<n; a++) for(int b=0; b<n; b++) k[a][b] = -Z[(i*n+a)*n+b];
+            mul_sub_lanes(k, yl, y);
+            store_lanes(work, i, y);
+        }
+    }
+
+    static inline void load_lanes(Grid<n> &work, int i, float (&v)[n][SOLVER_LANES]) {
+        for(int a=0; a<n; a++) memcpy(v[a], work.row(a, i), sizeof(v[a]));
+    }
+
+    static inline void store_lanes(Grid<n> &work, int i, const float (&v)[n][SOLVER_LANES]) {
+        for(int a=0; a<n; a++) memcpy(work.row(a, i), v[a], sizeof(v[a]));
+    }
+
+    // out = k v
+    static inline void mul_lanes(const float *k_in, const float (&v)[n][SOLVER_LANES],
+        float (&out)[n][SOLVER_LANES]
+    ) {
+        float k[n][n];
+        memcpy(k, k_in, sizeof(k));
+        for(int a=0; a<n; a++) {
+            for(int x=0; x<SOLVER_LANES; x++) out[a][x] = 0;
+            for(int b=0; b<n; b++) {
+                for(int x=0; x<SOLVER_LANES; x++) out[a][x] += k[a][b] * v[b][x];
+            }
+        }
+    }
+
+    // out -= k v
+    static inline void mul_sub_lanes(const float (&k)[n][n],
+        const float (&v)[n][SOLVER_LANES], float (&out)[n][SOLVER_LANES]
+    ) {
+        for(int a=0; a<n; a++) {
+            for(int b=0; b<n; b++) {
+                for(int x=0; x<SOLVER_LANES; x++) out[a][x] -= k[a][b] * v[b][x];
+            }
+        }
+    }
+
+    int N;
+    // Z is only applied to points [0,z_head) and [z_tail,N-1).
+    int z_head, z_tail;
+    float M_prev[n][n];
+    float C[n][n], S[n][n];
+    std::vector<float> P, cp, Z;
+};
+
+struct GridsBase {
+    GridsBase(int _w, int _h, int _format) :
+        w(_w), h(_h), wh(_w*_h), format(_format), topology(RDN_TOPOLOGY_KLEIN),
+        laplacian(RDN_LAPLACIAN_5_POINT)
+    { }
+
+    virtual ~GridsBase() { }
+
+    virtual int get_n() = 0;
+
+    // Copies the state out as get_n() unpadded planes.
+    virtual void get_state(float *dst) = 0;
+
+    // Copies the state into dst, which is reused if it is a grid of the same shape and
+    // format and deleted otherwise.  Returns the copy.
+    virtual GridsBase *snapshot(GridsBase *dst) = 0;
+
+    const int w, h, wh;
+    // One of RdnStorageFormat.
+    const int format;
+    // One of RdnTopology.
+    int topology;
+    // One of RdnLaplacian, used by explicit diffusion.
+    int laplacian;
+};
+
+template <int n>
+struct GridsN : public GridsBase {
+    // lo and hi give the range of values of each component, used to scale the int16
+    // format.
+    GridsN(int _w, int _h, int _format, const vecn &lo, const vecn &hi) :
+        GridsBase(_w, _h, _format),
+        gridA(NULL),
+        gridB(NULL),
+        packedA(NULL),
+        packedB(NULL),
+        pass_serial(0),
+        scratch(NULL)
+    {
+        if(format == RDN_STORAGE_FLOAT) {
+            gridA = new Grid<n>(w, h);
+        } else {
+            packedA = new Grid<n, uint16_t>(w, h);
+        }
+        for(int i=0; i<n; i++) {
+            fixed_offset[i] = (lo[i] + hi[i]) / 2.0f;
+            fixed_scale[i] = 32767.0f / std::max((hi[i] - lo[i]) / 2.0f, 1e-6f);
+            fixed_inv_scale[i] = 1.0f / fixed_scale[i];
+        }
+    }
+
+    ~GridsN() {
+        delete(gridA);
+        delete(gridB);
+        delete(packedA);
+        delete(packedB);
+        delete(scratch);
+        for(size_t i=0; i<tiles.size(); i++) delete(tiles[i]);
+        for(size_t i=0; i<render_rows.size(); i++) delete(render_rows[i]);
+        for(size_t i=0; i<solver_work.size(); i++) delete(solver_work[i]);
+    }
+
+    int get_n() { return n; }
+
+    // With a compact format there is no float copy of the state.  step() then always runs
+    // temporally blocked, converting rows as tiles are loaded and stored, and draw()
+    // decodes rows as it goes.
+    bool is_compact() { return format != RDN_STORAGE_FLOAT; }
+
+    // Size of the state as stored.
+    double state_bytes() {
+        return (double)n * wh * (is_compact() ? sizeof(uint16_t) : sizeof(float));
+    }
+
+    // Copies the state in from get_n() planes as get_state() lays them out.
+    void set_state(const float *src) {
+        for(int y=0; y<h; y++) {
+            Row<n> row;
+            for(int i=0; i<n; i++) row.c[i] = const_cast<float *>(src + (i*h + y)*w);
+            store_row(y, row);
+        }
+    }
+
+    // Fills rows [y0,y1) with the state of src resampled to the size of this grid, tx and
+    // ty being the taps from src->w to w and src->h to h.
+    void resample_rows(GridsN<n> *src, const ResampleTaps &tx, const ResampleTaps &ty,
+        int y0, int y1
+    ) {
+        Grid<n> line(src->w, 2);
+        Row<n> in = line.get_row(0);
+        Row<n> acc = line.get_row(1);
+        Grid<n> out_line(w, 1);
+        Row<n> out = out_line.get_row(0);
+        for(int y=y0; y<y1; y++) {
+            for(int i=0; i<n; i++) memset(acc.c[i], 0, src->w * sizeof(float));
+            for(int k=ty.start[y]; k<ty.start[y+1]; k++) {
+                src->load_row(ty.index[k], in);
+                for(int i=0; i<n; i++) {
+                    for(int x=0; x<src->w; x++) acc.c[i][x] += ty.weight[k] * in.c[i][x];
+                }
+            }
+            for(int i=0; i<n; i++) {
+                for(int x=0; x<w; x++) {
+                    float v = 0;
+                    for(int k=tx.start[x]; k<tx.start[x+1]; k++) {
+                        v += tx.weight[k] * acc.c[i][tx.index[k]];
+                    }
+                    out.c[i][x] = v;
+                }
+            }
+            store_row(y, out);
+        }
+    }
+
+    void get_state(float *dst) {
+        for(int y=0; y<h; y++) {
+            Row<n> row;
+            for(int i=0; i<n; i++) row.c[i] = dst + (i*h + y)*w;
+            load_row(y, row);
+        }
+    }
+
+    GridsBase *snapshot(GridsBase *dst_base) {
+        GridsN<n> *dst = dynamic_cast<GridsN<n> *>(dst_base);
+        if(!dst || dst->w != w || dst->h != h || dst->format != format) {
+            delete(dst_base);
+            dst = new GridsN<n>(w, h, format, vecn::Zero(), vecn::Zero());
+            memcpy(dst->fixed_offset, fixed_offset, sizeof(fixed_offset));
+            memcpy(dst->fixed_scale, fixed_scale, sizeof(fixed_scale));
+            memcpy(dst->fixed_inv_scale, fixed_inv_scale, sizeof(fixed_inv_scale));
+        }
+        dst->topology = topology;
+        dst->laplacian = laplacian;
+        // The planes of a grid are allocated in one piece.
+        if(is_compact()) {
+            memcpy(dst->packedA->c[0], packedA->c[0],
+                n * packedA->plane_size * sizeof(uint16_t));
+        } else {
+            memcpy(dst->gridA->c[0], gridA->c[0], n * gridA->plane_size * sizeof(float));
+        }
+        return dst;
+    }
+
+    // Reads row y of the state as floats.
+    void load_row(int y, const Row<n> &dst) {
+        for(int i=0; i<n; i++) {
+            switch(format) {
+                case RDN_STORAGE_FP16:
+                    decode_half_row(packedA->row(i, y), dst.c[i], w);
+                    break;
+                case RDN_STORAGE_INT16:
+                    decode_fixed_row(packedA->row(i, y), dst.c[i], w,
+                        fixed_offset[i], fixed_inv_scale[i]);
+                    break;
+                default:
+                    memcpy(dst.c[i], gridA->row(i, y), w*sizeof(float));
+            }
+        }
+    }
+
+    // Writes row y of the state, or of the back grid (see alloc_back_grid).  Rows of the
+    // back grid are the results of a step, and are rounded stochastically (see storage.h).
+    void store_row(int y, const Row<n> &src, bool back=false) {
+        for(int i=0; i<n; i++) {
+            // Different noise for every row, component and pass.
+            uint32_t seed = (pass_serial * n + i) * h + y;
+            switch(format) {
+                case RDN_STORAGE_FP16:
+                    if(back) {
+                        encode_half_row_stochastic(src.c[i], packedB->row(i, y), w, seed);
+                    } else {
+                        encode_half_row(src.c[i], packedA->row(i, y), w);
+                    }
+                    break;
+                case RDN_STORAGE_INT16:
+                    if(back) {
+                        encode_fixed_row_stochastic(src.c[i], packedB->row(i, y), w,
+                            fixed_offset[i], fixed_scale[i], seed);
+                    } else {
+                        encode_fixed_row(src.c[i], packedA->row(i, y), w,
+                            fixed_offset[i], fixed_scale[i]);
+                    }
+                    break;
+                default:
+                    memcpy((back ? gridB : gridA)->row(i, y), src.c[i], w*sizeof(float));
+            }
+        }
+    }
+
+    // Samples every PROBE_SPACING-th row of the state, so that probe_change() can tell how
+    // much a step changed it.
+    void save_probe() {
+        Grid<n> line(w, 1);
+        Row<n> row = line.get_row(0);
+        probe.clear();
+        for(int y=0; y<h; y+=PROBE_SPACING) {
+            load_row(y, row);
+            for(int i=0; i<n; i++) probe.insert(probe.end(), row.c[i], row.c[i] + w);
+        }
+    }
+
+    int num_probe_rows() { return (h + PROBE_SPACING - 1) / PROBE_SPACING; }
+
+    // Copies sampled row k, as saved by save_probe(), into dst.
+    void load_probe(int k, const Row<n> &dst) {
+        const float *p = &probe[k*n*w];
+        for(int i=0; i<n; i++) memcpy(dst.c[i], p + i*w, w*sizeof(float));
+    }
+
+    // RMS difference between the sampled rows and save_probe().
+    float probe_change() {
+        Grid<n> line(w, 1);
+        Row<n> row = line.get_row(0);
+        const float *p = probe.empty() ? NULL : &probe[0];
+        double sum = 0;
+        for(int y=0; y<h; y+=PROBE_SPACING) {
+            load_row(y, row);
+            for(int i=0; i<n; i++) {
+                for(int x=0; x<w; x++) {
+                    float d = row.c[i][x] - *p++;
+                    sum += d*d;
+                }
+            }
+        }
+        return probe.empty() ? 0 : sqrtf(sum / probe.size());
+    }
+
+    // Whether every value of the state is finite and within lo..hi, that is whether the
+    // int16 format with that range holds it without clipping.
+    bool in_range(const vecn &lo, const vecn &hi) {
+        Grid<n> line(w, 1);
+        Row<n> row = line.get_row(0);
+        for(int y=0; y<h; y++) {
+            load_row(y, row);
+            for(int i=0; i<n; i++) {
+                for(int x=0; x<w; x++) {
+                    // Written so that NaN fails too.
+                    if(!(row.c[i][x] >= lo[i] && row.c[i][x] <= hi[i])) return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Checked after each step, since an unstable simulation quickly spreads NaN everywhere.
+    bool is_finite() {
+        switch(format) {
+            case RDN_STORAGE_FP16:
+                return std::isfinite(half_to_float(packedA->c[0][0]));
+            case RDN_STORAGE_INT16:
+                return packedA->c[0][0] != FIXED_NAN;
+            default:
+                return std::isfinite(gridA->c[0][0]);
+        }
+    }
+
+    // Fills in the ghost columns of a row (see GRID_ALIGN): the other end of the row, which
+    // is the horizontal neighbour in every topology but RDN_TOPOLOGY_NEUMANN, or else the
+    // end itself (a mirror image of the row past the edge, so nothing flows across it).
+    void fill_ghost_columns(const Row<n> &r) {
+        bool wrap = topology != RDN_TOPOLOGY_NEUMANN;
+        for(int i=0; i<n; i++) {
+            r.c[i][-1] = r.c[i][wrap ? w-1 : 0];
+            r.c[i][w] = r.c[i][wrap ? 0 : w-1];
+        }
+    }
+
+    // Which row of the state row g is, for g outside [0,h): past the top or bottom of a
+    // Klein bottle the rows come back from the other edge mirrored left to right; a torus
+    // just wraps around; the Neumann boundary reflects, so row -1 is row 0.  Returns
+    // whether the row is mirrored.
+    bool wrap_row(int g, int &y) {
+        if(topology == RDN_TOPOLOGY_NEUMANN) {
+            int r = g % (2*h);
+            if(r < 0) r += 2*h;
+            y = r < h ? r : 2*h-1-r;
+            return false;
+        }
+        int k = g >= 0 ? g / h : -((h-1-g) / h);
+        y = g - k*h;
+        return topology == RDN_TOPOLOGY_KLEIN && (k & 1);
+    }
+
+    // A += m2 * laplacian(A) is applied in place, one row band per thread.  Each band
+    // first saves its top and bottom rows (save_band_edges), since the neighbouring bands
+    // need their old values; after a barrier, diffuse_band updates the band.  Band 0 also
+    // makes the ghost rows above and below the grid, as given by wrap_row, which the first
+    // and last bands see beyond their edge.  Scratch has four rows per band and then the
+    // two ghost rows.  With a single band this is just a sweep over the whole grid.
+    void set_num_bands(int count) {
+        if(scratch && scratch->h == 4*count+2) return;
+        delete(scratch);
+        scratch = new Grid<n>(w, 4*count+2);
+    }
+
+    int get_num_bands() {
+        return scratch ? (scratch->h - 2) / 4 : 0;
+    }
+
+    void save_band_edges(int band) {
+        int count = get_num_bands();
+        int y0 = band_start(h, band, count);
+        int y1 = band_start(h, band+1, count);
+        Row<n> top = scratch->get_row(4*band);
+        Row<n> bot = scratch->get_row(4*band+1);
+        for(int i=0; i<n; i++) {
+            memcpy(top.c[i], gridA->row(i, y0  ), w*sizeof(float));
+            memcpy(bot.c[i], gridA->row(i, y1-1), w*sizeof(float));
+        }
+        fill_ghost_columns(top);
+        fill_ghost_columns(bot);
+        if(band == 0) {
+            load_row_wrapped(-1, scratch->get_row(4*count));
+            load_row_wrapped(h, scratch->get_row(4*count+1));
+            fill_ghost_columns(scratch->get_row(4*count));
+            fill_ghost_columns(scratch->get_row(4*count+1));
+        }
+    }
+
+    void diffuse_band(const float (&M)[n][n], int band) {
+        int count = get_num_bands();
+        int y0 = band_start(h, band, count);
+        int y1 = band_start(h, band+1, count);
+        Row<n> above = scratch->get_row(band > 0 ? 4*(band-1)+1 : 4*count);
+        Row<n> below = scratch->get_row(band < count-1 ? 4*(band+1) : 4*count+1);
+        diffuse_rows(M, y0, y1, above, below, scratch->get_row(4*band+2),
+            scratch->get_row(4*band+3));
+    }
+
+    // Updates rows [y0,y1) in place, only within the spans given by row_spans().
+    // above/below hold the old values of the rows just outside the range, with their ghost
+    // columns filled in.  The old value of the previous row is kept in a two-row rolling
+    // buffer, so nothing else needs to be written but the ghost columns of the next row.
+    // Only the cells the spans read are saved, and where the spans change (at the top of
+    // a row of tiles) the rest of the previous row is still as it was in the grid.
+    void diffuse_rows(const float (&M)[n][n], int y0, int y1,
+        const Row<n> &above, const Row<n> &below, Row<n> prev, Row<n> cur
+    ) {
+        bool nine = laplacian == RDN_LAPLACIAN_9_POINT;
+        // Whether prev holds row y-1 for the spans prev_sp.  If row y-1 had no spans at
+        // all, the grid still holds it.
+        bool prev_saved = true;
+        const int *prev_sp = NULL;
+        int prev_num_spans = 0;
+        for(int y=y0; y<y1; y++) {
+            const int *sp;
+            int num_spans = row_spans(y, sp);
+            if(!num_spans) {
+                prev_saved = false;
+                continue;
+            }
+            Row<n> A = gridA->get_row(y);
+            copy_spans(A, cur, sp, num_spans);
+            fill_ghost_columns(cur);
+            Row<n> up = y==y0 ? above : prev_saved ? prev : gridA->get_row(y-1);
+            if(y != y0 && prev_saved && sp != prev_sp) {
+                copy_outside_spans(gridA->get_row(y-1), prev, prev_sp, prev_num_spans);
+                fill_ghost_columns(prev);
+            }
+            if(y != y0 && !prev_saved && nine) fill_ghost_columns(up);
+            Row<n> dn = y+1<y1 ? gridA->get_row(y+1) : below;
+            if(y+1<y1 && nine) fill_ghost_columns(dn);
+            for(int k=0; k<num_spans; k++) {
+                int x0 = sp[2*k], x1 = sp[2*k+1];
+                diffuse_row(M, A.offset(x0), cur.offset(x0), up.offset(x0), dn.offset(x0),
+                    x1-x0);
+            }
+            std::swap(prev, cur);
+            prev_saved = true;
+            prev_sp = sp;
+            prev_num_spans = num_spans;
+        }
+    }
+
+    // Copies what the stencil reads of src over the spans into dst: the spans with a cell
+    // on either side, and the end cells that the ghost columns are made of.
+    void copy_spans(const Row<n> &src, const Row<n> &dst, const int *sp, int num_spans) {
+        for(int i=0; i<n; i++) {
+            for(int k=0; k<num_spans; k++) {
+                int x0 = std::max(sp[2*k] - 1, 0);
+                int x1 = std::min(sp[2*k+1] + 1, w);
+                memcpy(dst.c[i] + x0, src.c[i] + x0, (x1-x0)*sizeof(float));
+            }
+            dst.c[i][0] = src.c[i][0];
+            dst.c[i][w-1] = src.c[i][w-1];
+        }
+    }
+
+    // Copies the rest of src, everything outside the spans, into dst.
+    void copy_outside_spans(const Row<n> &src, const Row<n> &dst, const int *sp,
+        int num_spans
+    ) {
+        for(int i=0; i<n; i++) {
+            int x = 0;
+            for(int k=0; k<=num_spans; k++) {
+                int end = k < num_spans ? sp[2*k] : w;
+                memcpy(dst.c[i] + x, src.c[i] + x, (end-x)*sizeof(float));
+                if(k < num_spans) x = sp[2*k+1];
+            }
+        }
+    }
+
+    // out = cur + M * laplacian over w cells, with the ghost columns of cur filled in, and
+    // those of up and dn too for the 9-point stencil.
+    void diffuse_row(const float (&M)[n][n], const Row<n> &out,
+        const Row<n> &cur, const Row<n> &up, const Row<n> &dn, int w
+    ) {
+        bool nine = laplacian == RDN_LAPLACIAN_9_POINT;
+        if(n <= 4) {
+            const SimdKernels &k = simd_kernels();
+            (nine ? k.diffuse_row_9 : k.diffuse_row)[n](&M[0][0], out.c, cur.c, up.c, dn.c, w);
+            return;
+        }
+        for(int x=0; x<w; x++) {
+            float l[n];
+            for(int j=0; j<n; j++) {
+                if(!nine) {
+                    l[j] = -4.0f * cur.c[j][x] + (up.c[j][x] + dn.c[j][x]) +
+                        (cur.c[j][x-1] + cur.c[j][x+1]);
+                    continue;
+                }
+                float t = -20.0f * cur.c[j][x];
+                t += 4.0f * ((up.c[j][x] + dn.c[j][x]) + (cur.c[j][x-1] + cur.c[j][x+1]));
+                t += (up.c[j][x-1] + up.c[j][x+1]) + (dn.c[j][x-1] + dn.c[j][x+1]);
+                l[j] = (1.0f / 6.0f) * t;
+            }
+            for(int i=0; i<n; i++) {
+                float acc = 0;
+                for(int j=0; j<n; j++) acc += M[i][j] * l[j];
+                out.c[i][x] = cur.c[i][x] + acc;
+            }
+        }
+    }
+
+    // Implicit diffusion (see CyclicSolver) is split into a solve along each row and then
+    // along each column.  Lines are solved SOLVER_LANES at a time, gathered into a
+    // per-thread work buffer so the recurrences vectorize across lines.
+    //
+    // The solver only does cyclic lines.  A Neumann boundary is the same as a cyclic line
+    // of twice the length with the data mirrored in the second half (that is how
+    // wrap_row extends the grid too), so with RDN_TOPOLOGY_NEUMANN rows are lines of 2w
+    // points and columns lines of 2h.  Otherwise rows simply wrap around.
+    Grid<n> *get_solver_work(int band) {
+        return get_band_buffer(solver_work, band, 2*std::max(w, h), SOLVER_LANES);
+    }
+
+    int row_line_length() {
+        return topology == RDN_TOPOLOGY_NEUMANN ? 2*w : w;
+    }
+
+    void implicit_rows(const CyclicSolver<n> &solver, int band, int y0, int y1) {
+        Grid<n> *work = get_solver_work(band);
+        bool mirror = topology == RDN_TOPOLOGY_NEUMANN;
+        for(int r0=y0; r0<y1; r0+=SOLVER_LANES) {
+            int cnt = std::min(SOLVER_LANES, y1-r0);
+            for(int a=0; a<n; a++) {
+                for(int r=0; r<cnt; r++) {
+                    const float *src = gridA->row(a, r0+r);
+                    for(int x=0; x<w; x++) work->row(a, x)[r] = src[x];
+                    if(!mirror) continue;
+                    for(int x=0; x<w; x++) work->row(a, 2*w-1-x)[r] = src[x];
+                }
+            }
+            solver.solve(*work);
+            for(int a=0; a<n; a++) {
+                for(int r=0; r<cnt; r++) {
+                    float *dst = gridA->row(a, r0+r);
+                    for(int x=0; x<w; x++) dst[x] = work->row(a, x)[r];
+                }
+            }
+        }
+    }
+
+    // Columns are solved as lines of 2h points or of h points, by pair_solver and
+    // single_solver respectively.  On a Klein bottle going down past the last row of
+    // column x leads to the top of column w-1-x, so columns are solved in pairs: column x,
+    // then column w-1-x.  With odd w the middle column pairs with itself and is a single
+    // line.  On a torus every column is a single line, and with the Neumann boundary every
+    // column is the first half of a line of 2h, the second half being its mirror image.
+    // The lines are split into count bands.
+    void implicit_columns(const CyclicSolver<n> &pair_solver,
+        const CyclicSolver<n> &single_solver, int band, int count
+    ) {
+        Grid<n> *work = get_solver_work(band);
+        // Lines [0,pairs) are of 2h points and [pairs,lines) of h.
+        int pairs, lines;
+        switch(topology) {
+            case RDN_TOPOLOGY_TORUS:   pairs = 0;   lines = w; break;
+            case RDN_TOPOLOGY_NEUMANN: pairs = w;   lines = w; break;
+            default:                   pairs = w/2; lines = (w+1)/2; break;
+        }
+        bool klein = topology == RDN_TOPOLOGY_KLEIN;
+        int l0 = band_start(lines, band, count);
+        int l1 = band_start(lines, band+1, count);
+
+        for(int c0=l0; c0<std::min(l1, pairs); c0+=SOLVER_LANES) {
+            int cnt = std::min(SOLVER_LANES, std::min(l1, pairs)-c0);
+            for(int a=0; a<n; a++) {
+                for(int y=0; y<h; y++) {
+                    const float *src = gridA->row(a, y);
+                    const float *mir = gridA->row(a, h-1-y);
+                    float *top = work->row(a, y);
+                    float *bot = work->row(a, y+h);
+                    for(int x=0; x<cnt; x++) {
+                        top[x] = src[c0+x];
+                        bot[x] = klein ? src[w-1-c0-x] : mir[c0+x];
+                    }
+                }
+            }
+            pair_solver.solve(*work);
+            for(int a=0; a<n; a++) {
+                for(int y=0; y<h; y++) {
+                    float *dst = gridA->row(a, y);
+                    const float *top = work->row(a, y);
+                    const float *bot = work->row(a, y+h);
+                    for(int x=0; x<cnt; x++) {
+                        dst[c0+x] = top[x];
+                        if(klein) dst[w-1-c0-x] = bot[x];
+                    }
+                }
+            }
+        }
+
+        for(int c0=std::max(l0, pairs); c0<l1; c0+=SOLVER_LANES) {
+            int cnt = std::min(SOLVER_LANES, l1-c0);
+            for(int a=0; a<n; a++) {
+                for(int y=0; y<h; y++) {
+                    const float *src = gridA->row(a, y);
+                    float *dst = work->row(a, y);
+                    for(int x=0; x<cnt; x++) dst[x] = src[c0+x];
+                }
+            }
+            single_solver.solve(*work);
+            for(int a=0; a<n; a++) {
+                for(int y=0; y<h; y++) {
+                    float *dst = gridA->row(a, y);
+                    const float *src = work->row(a, y);
+                    for(int x=0; x<cnt; x++) dst[c0+x] = src[x];
+                }
+            }
+        }
+    }
+
+    // Reads row g of the state into dst, where g may lie outside [0,h) (see wrap_row).
+    void load_row_wrapped(int g, const Row<n> &dst) {
+        int y;
+        bool mirrored = wrap_row(g, y);
+        load_row(y, dst);
+        if(mirrored) {
+            for(int i=0; i<n; i++) std::reverse(dst.c[i], dst.c[i] + w);
+        }
+    }
+
+    // Row g of the state like load_row_wrapped, but a float row inside the grid is used in
+    // place rather than copied into buf.
+    Row<n> view_row_wrapped(int g, const Row<n> &buf) {
+        if(!is_compact() && g >= 0 && g < h) return gridA->get_row(g);
+        load_row_wrapped(g, buf);
+        return buf;
+    }
+
+    // Makes room for the per-thread buffers of count threads.  This has to be done before
+    // the threads start, which would otherwise resize the vectors under each other.
+    void reserve_band_buffers(int count) {
+        if((int)tiles.size() < count) tiles.resize(count, NULL);
+        if((int)render_rows.size() < count) render_rows.resize(count, NULL);
+        if((int)solver_work.size() < count) solver_work.resize(count, NULL);
+    }
+
+    // Per-thread row buffers, reallocated if the size changes.  Rows are the width of the
+    // grid unless given otherwise.  See reserve_band_buffers().
+    Grid<n> *get_band_buffer(std::vector<Grid<n> *> &bufs, int band, int rows, int width=0) {
+        if(!width) width = w;
+        if(!bufs[band] || bufs[band]->h != rows || bufs[band]->w != width) {
+            delete(bufs[band]);
+            bufs[band] = new Grid<n>(width, rows);
+        }
+        return bufs[band];
+    }
+
+    // Tile buffers for temporal blocking.
+    Grid<n> *get_tile(int band, int rows) {
+        return get_band_buffer(tiles, band, rows);
+    }
+
+    // The grid that temporally blocked passes write into (see store_row); swapped with the
+    // state afterwards by swap_back_grid.
+    void alloc_back_grid() {
+        if(is_compact()) {
+            if(!packedB) packedB = new Grid<n, uint16_t>(w, h);
+        } else {
+            if(!gridB) gridB = new Grid<n>(w, h);
+        }
+    }
+
+    void swap_back_grid() {
+        std::swap(gridA, gridB);
+        std::swap(packedA, packedB);
+        pass_serial++;
+    }
+
+    // Diffusion within a tile: rows [lo,hi) are updated in place, reading rows lo-1 and hi
+    // as they are.  Tile rows are already unwrapped, so there is no mirroring here.
+    void diffuse_tile_rows(const float (&M)[n][n], Grid<n> &t, int lo, int hi,
+        Row<n> prev, Row<n> cur
+    ) {
+        bool nine = laplacian == RDN_LAPLACIAN_9_POINT;
+        if(nine) fill_ghost_columns(t.get_row(lo-1));
+        for(int y=lo; y<hi; y++) {
+            Row<n> A = t.get_row(y);
+            for(int i=0; i<n; i++) {
+                memcpy(cur.c[i], A.c[i], w*sizeof(float));
+            }
+            fill_ghost_columns(cur);
+            Row<n> up = y==lo ? t.get_row(y-1) : prev;
+            Row<n> dn = t.get_row(y+1);
+            if(nine) fill_ghost_columns(dn);
+            diffuse_row(M, A, cur, up, dn, w);
+            std::swap(prev, cur);
+        }
+    }
+
+    // The gradient (central differences) and, unless L is NULL, the Laplacian of row cur,
+    // given along with the (already unwrapped) rows above and below it.  This fills in the
+    // ghost columns of cur.  Rendering computes these a row at a time as it goes, so they
+    // are never stored for the whole grid.
+    void derivative_row(const Row<n> &up, const Row<n> &cur, const Row<n> &dn,
+        const Row<n> &DX, const Row<n> &DY, const Row<n> *L
+    ) {
+        fill_ghost_columns(cur);
+        for(int i=0; i<n; i++) {
+            const float *A = cur.c[i];
+            const float *Aup = up.c[i];
+            const float *Adn = dn.c[i];
+            float *dx = DX.c[i];
+            float *dy = DY.c[i];
+            for(int x=0; x<w; x++) dx[x] = A[x+1] - A[x-1];
+            for(int x=0; x<w; x++) dy[x] = Aup[x] - Adn[x];
+            if(!L) continue;
+            float *l = L->c[i];
+            for(int x=0; x<w; x++) {
+                l[x] = -4.0f * A[x] + (Aup[x] + Adn[x]) + (A[x-1] + A[x+1]);
+            }
+        }
+    }
+
+    // Sparse stepping (see rdn_set_sparse_threshold).  quiet[] holds a flag per tile of
+    // ACTIVE_TILE x ACTIVE_TILE cells, set if at the end of the last step every cell of the
+    // tile was within quiet_eps of quiet_val.  A tile is stepped unless it and all the
+    // tiles around it are quiet, and each row is only updated within the spans of stepped
+    // tiles.  Skipping is safe while one step can't carry a change across a whole tile,
+    // which it does by a cell per diffusion substep.
+    int tiles_x() { return (w + ACTIVE_TILE - 1) / ACTIVE_TILE; }
+    int tiles_y() { return (h + ACTIVE_TILE - 1) / ACTIVE_TILE; }
+
+    // Marks every tile as stepped and forgets which were quiet.  Returns the number of
+    // tiles.
+    int set_all_active() {
+        quiet.clear();
+        stepped.assign(tiles_x() * tiles_y(), 1);
+        build_spans();
+        return stepped.size();
+    }
+
+    // Picks the tiles to step, given the fixed point and threshold that quiet[] is to be
+    // measured against.  Returns the number of stepped tiles.
+    int plan_active(const float *val, float eps) {
+        int tw = tiles_x(), th = tiles_y();
+        bool same = quiet.size() == (size_t)(tw*th) && eps == quiet_eps &&
+            std::equal(val, val+n, quiet_val);
+        if(!same) {
+            quiet.assign(tw*th, 0);
+            std::copy(val, val+n, quiet_val);
+            quiet_eps = eps;
+        }
+        find_reach();
+        int count = 0;
+        stepped.resize(tw*th);
+        for(int ty=0; ty<th; ty++) {
+            for(int tx=0; tx<tw; tx++) {
+                bool skip = tile_settled(tx, ty);
+                stepped[ty*tw + tx] = !skip;
+                count += !skip;
+            }
+        }
+        build_spans();
+        return count;
+    }
+
+    // Whether the tiles holding any cell within ACTIVE_TILE cells of tile (tx, ty) are all
+    // quiet, using the lists made by find_reach().
+    bool tile_settled(int tx, int ty) {
+        int tw = tiles_x();
+        const std::vector<int> &rows = reach_rows[ty];
+        for(size_t j=0; j<rows.size(); j++) {
+            // Tile row, times two, plus one if mirrored.
+            const uint8_t *q = &quiet[(rows[j] >> 1) * tw];
+            const std::vector<int> &cols = reach_cols[rows[j] & 1][tx];
+            for(size_t i=0; i<cols.size(); i++) {
+                if(!q[cols[i]]) return false;
+            }
+        }
+        return true;
+    }
+
+    // Lists the tiles within ACTIVE_TILE cells of each tile, by row and by column.  Past
+    // the edges the cells follow wrap_row and the ghost columns, so the columns are listed
+    // for plain and for mirrored rows.
+    void find_reach() {
+        int tw = tiles_x(), th = tiles_y();
+        for(int m=0; m<2; m++) reach_cols[m].assign(tw, std::vector<int>());
+        for(int tx=0; tx<tw; tx++) {
+            int x1 = std::min(tx*ACTIVE_TILE + ACTIVE_TILE, w) + ACTIVE_TILE;
+            for(int gx=tx*ACTIVE_TILE - ACTIVE_TILE; gx<x1; gx++) {
+                int x = wrap_column(gx);
+                add_once(reach_cols[0][tx], x / ACTIVE_TILE);
+                add_once(reach_cols[1][tx], (w-1-x) / ACTIVE_TILE);
+            }
+        }
+        reach_rows.assign(th, std::vector<int>());
+        for(int ty=0; ty<th; ty++) {
+            int y1 = std::min(ty*ACTIVE_TILE + ACTIVE_TILE, h) + ACTIVE_TILE;
+            for(int gy=ty*ACTIVE_TILE - ACTIVE_TILE; gy<y1; gy++) {
+                int y;
+                bool mirrored = wrap_row(gy, y);
+                add_once(reach_rows[ty], (y / ACTIVE_TILE) * 2 + mirrored);
+            }
+        }
+    }
+
+    static void add_once(std::vector<int> &v, int x) {
+        if(std::find(v.begin(), v.end(), x) == v.end()) v.push_back(x);
+    }
+
+    // Which column of the state column g is, for g outside [0,w), as the ghost columns
+    // have it.
+    int wrap_column(int g) {
+        int x = g % (2*w);
+        if(x < 0) x += 2*w;
+        if(x < w) return x;
+        return topology == RDN_TOPOLOGY_NEUMANN ? 2*w-1-x : x-w;
+    }
+
+    void build_spans() {
+        int tw = tiles_x(), th = tiles_y();
+        spans.clear();
+        span_start.assign(1, 0);
+        for(int ty=0; ty<th; ty++) {
+            for(int tx=0; tx<tw; tx++) {
+                if(!stepped[ty*tw + tx]) continue;
+                int x0 = tx * ACTIVE_TILE;
+                int x1 = std::min(x0 + ACTIVE_TILE, w);
+                if(spans.size() > (size_t)2*span_start.back() && spans.back() == x0) {
+                    spans.back() = x1;
+                } else {
+                    spans.push_back(x0);
+                    spans.push_back(x1);
+                }
+            }
+            span_start.push_back(spans.size() / 2);
+        }
+    }
+
+    // The spans [sp[2*k], sp[2*k+1]) of row y to update; returns how many there are.
+    int row_spans(int y, const int *&sp) {
+        int ty = y / ACTIVE_TILE;
+        sp = spans.empty() ? NULL : &spans[2*span_start[ty]];
+        return span_start[ty+1] - span_start[ty];
+    }
+
+    // Measures quiet[] again for the stepped tiles in tile rows [ty0,ty1).  The others
+    // haven't changed.
+    void update_quiet(int ty0, int ty1) {
+        if(quiet.empty()) return;
+        int tw = tiles_x();
+        for(int ty=ty0; ty<ty1; ty++) {
+            int y0 = ty * ACTIVE_TILE;
+            int y1 = std::min(y0 + ACTIVE_TILE, h);
+            for(int tx=0; tx<tw; tx++) {
+                if(!stepped[ty*tw + tx]) continue;
+                int x0 = tx * ACTIVE_TILE;
+                int x1 = std::min(x0 + ACTIVE_TILE, w);
+                bool q = true;
+                for(int i=0; i<n && q; i++) {
+                    float lo = quiet_val[i] - quiet_eps;
+                    float hi = quiet_val[i] + quiet_eps;
+                    for(int y=y0; y<y1 && q; y++) {
+                        const float *p = gridA->row(i, y);
+                        // Written so that NaN isn't quiet.
+                        for(int x=x0; x<x1; x++) q &= p[x] >= lo && p[x] <= hi;
+                    }
+                }
+                quiet[ty*tw + tx] = q;
+            }
+        }
+    }
+
+    // Forgets which tiles were quiet, after the state has been changed from outside.
+    void clear_quiet() {
+        quiet.clear();
+    }
+
+    // Float state, NULL with a compact format.
+    Grid<n> *gridA;
+    Grid<n> *gridB;
+    // Compact state, NULL with the float format.
+    Grid<n, uint16_t> *packedA;
+    Grid<n, uint16_t> *packedB;
+    float fixed_offset[n], fixed_scale[n], fixed_inv_scale[n];
+    // Passes written through the back grid so far, which seeds the rounding noise.
+    uint32_t pass_serial;
+    // Band edges and rolling row buffers for diffuse_band(), four rows per band, and the
+    // ghost rows.
+    Grid<n> *scratch;
+    std::vector<Grid<n> *> tiles;
+    std::vector<Grid<n> *> render_rows;
+    std::vector<Grid<n> *> solver_work;
+    std::vector<float> probe;
+    // The activity map (see plan_active), empty unless the last step was sparse.
+    std::vector<uint8_t> quiet, stepped;
+    // See find_reach().
+    std::vector<std::vector<int> > reach_cols[2], reach_rows;
+    float quiet_val[n];
+    float quiet_eps;
+    // Runs of stepped tiles: tile row ty has the spans [spans[2*k], spans[2*k+1]) for k in
+    // [span_start[ty], span_start[ty+1]).
+    std::vector<int> spans, span_start;
+};
+
+GridsBase *grids = NULL;
+
+// The simulation thread (see rdn_start_simulation).  It holds sim_mutex while it steps,
+// and so does every entry point that changes what it works on.  Rendering doesn't: it
+// draws from copies of the state that the thread publishes through snapshots after each
+// step.  The write side of snapshots is only touched with sim_mutex held.
+bool sim_running = false;
+bool sim_quit = false;
+// Seconds between steps, or 0 to step as fast as possible.
+float sim_interval = 0;
+pthread_t sim_thread;
+pthread_mutex_t sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Wakes the thread from its sleep between steps when it has to quit.
+pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+TripleBuffer<GridsBase *> snapshots;
+// dir of the last rdn_render_frame() while the thread was running, or -1.
+int last_render_dir = -1;
+// Number of evolve() calls that stepped.
+unsigned step_count = 0;
+
+struct SimLock {
+    SimLock() { pthread_mutex_lock(&sim_mutex); }
+    ~SimLock() { pthread_mutex_unlock(&sim_mutex); }
+};
+
+// Copies the state into the write slot of snapshots and publishes it.  Must be called with
+// sim_mutex held.
+static void publish_state() {
+    if(!grids) return;
+    GridsBase *&slot = snapshots.write_slot();
+    slot = grids->snapshot(slot);
+    snapshots.publish();
+}
+
+// Per-phase timings (see rdn_get_stats).  Steps and frames may be timed on different
+// threads, so these are guarded by stats_mutex.
+PhaseStats phase_stats[RDN_PHASE_NUM_PHASES];
+pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Time spent in rdn_render_frame() since the last rdn_record_jni_time().
+double unreported_render_ms = 0;
+
+static void record_phase(int phase, double ms, double bytes) {
+    pthread_mutex_lock(&stats_mutex);
+    phase_stats[phase].add(ms, bytes);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+// Rows are rendered in chunks of RENDER_CHUNK pixels, small enough that the per-chunk
+// buffers stay in L1.
+#define RENDER_CHUNK 128
+
+// Scratch for one chunk.  The palette points f[0..num_features) at the feature rows its
+// color is made of: the lighting terms dp and spec, rows of its own in buf, or straight
+// into the grid rows.
+struct RenderChunk {
+    float sx[RENDER_CHUNK];
+    float sy[RENDER_CHUNK];
+    float dp[RENDER_CHUNK];
+    float spec[RENDER_CHUNK];
+    float buf[MAX_FEATURES][RENDER_CHUNK];
+    const float *f[MAX_FEATURES];
+};
+
+// Common helpers for palettes.  Palettes are template parameters of FunctionBase::draw,
+// so nothing here is virtual.  Each palette provides
+//
+//     enum { num_features = ... };
+//     // Fills in ch.f for pixels [x, x+cnt) of a row.
+//     void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+//         const Row<n> &bufDX, const Row<n> &bufDY,
+//         int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch);
+//
+// sets the color each feature contributes with set_feature() and set_constant(), and
+// overrides needs_laplacian if render_chunk reads bufL.  The pixel color is linear in the
+// features, so the color matrix is folded into those coefficients once (fold_colors)
+// rather than applied per pixel.
+template <int n>
+class Palette {
+public:
+    // Whether render_chunk reads bufL.  The Laplacian is only computed for palettes that do.
+    enum { needs_laplacian = 0 };
+
+    Palette() : folded_serial(-1) {
+        for(int c=0; c<3; c++) {
+            for(int k=0; k<=MAX_FEATURES; k++) basis[c][k] = 0;
+        }
+    }
+
+    // The color matrix applied to the palette colors, as a 3x5 matrix for emit_rgb24.
+    void fold_colors() {
+        if(folded_serial == color_matrix_serial) return;
+        for(int c=0; c<3; c++) {
+            const float *cm = color_matrix + c*5;
+            for(int k=0; k<=MAX_FEATURES; k++) {
+                folded[c*5+k] = cm[0]*basis[0][k] + cm[1]*basis[1][k] + cm[2]*basis[2][k];
+            }
+            folded[c*5+MAX_FEATURES] += cm[4];
+        }
+        folded_serial = color_matrix_serial;
+    }
+
+    float folded[3*5];
+
+protected:
+    void set_feature(int k, float r, float g, float b) {
+        basis[0][k] = r;
+        basis[1][k] = g;
+        basis[2][k] = b;
+    }
+
+    void set_constant(float r, float g, float b) {
+        set_feature(MAX_FEATURES, r, g, b);
+    }
+
+    // Lighting into ch.dp and ch.spec, for a surface with normal (sx, sy, 1).
+    static inline void shade(const Eigen::Vector3f &acc, int cnt, RenderChunk &ch) {
+        simd_kernels().shade(ch.sx, ch.sy, ch.dp, ch.spec, cnt, acc[0], acc[1], acc[2]);
+    }
+
+    // Slopes from the gradient of |A|^2.
+    static inline void shade_R2(const Row<n> &A, const Row<n> &DX, const Row<n> &DY,
+        int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+    ) {
+        for(int i=0; i<cnt; i++) {
+            float sx = 0, sy = 0;
+            for(int j=0; j<n; j++) {
+                sx += DX.c[j][x+i] * A.c[j][x+i];
+                sy += DY.c[j][x+i] * A.c[j][x+i];
+            }
+            ch.sx[i] = sx * 4.0f;
+            ch.sy[i] = sy * 4.0f;
+        }
+        shade(acc, cnt, ch);
+    }
+
+    // Slopes from the phase gradient of the first two components.
+    static inline void shade_cross(const Row<n> &A, const Row<n> &DX, const Row<n> &DY,
+        int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+    ) {
+        const float *A0 = A.c[0] + x, *A1 = A.c[1] + x;
+        const float *DX0 = DX.c[0] + x, *DX1 = DX.c[1] + x;
+        const float *DY0 = DY.c[0] + x, *DY1 = DY.c[1] + x;
+        for(int i=0; i<cnt; i++) {
+            ch.sx[i] = DX0[i]*A1[i] - DX1[i]*A0[i];
+            ch.sy[i] = DY0[i]*A1[i] - DY1[i]*A0[i];
+        }
+        shade(acc, cnt, ch);
+    }
+
+    // Slopes from the gradient of A[0].
+    static inline void shade_A(const Row<n> &DX, const Row<n> &DY,
+        int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+    ) {
+        const float *DX0 = DX.c[0] + x;
+        const float *DY0 = DY.c[0] + x;
+        for(int i=0; i<cnt; i++) {
+            ch.sx[i] = DX0[i] * 4.0f;
+            ch.sy[i] = DY0[i] * 4.0f;
+        }
+        shade(acc, cnt, ch);
+    }
+
+private:
+    // Color contributed by each feature, and the constant term in the last column.
+    float basis[3][MAX_FEATURES+1];
+    int folded_serial;
+};
+
+struct FunctionBaseBase {
+    FunctionBaseBase() :
+        diffusion_solver(RDN_DIFFUSION_EXPLICIT),
+        time_tolerance(0),
+        next_dt(0),
+        last_dt(0),
+        last_change(0),
+        active_tiles(0),
+        num_tiles(0),
+        diffusion_time(0),
+        reaction_time(0),
+        state_finite(true)
+    { }
+
+    virtual void set_params(const float *p, int len) = 0;
+
+    virtual void reset_grid() = 0;
+
+    // See rdn_suspend.
+    virtual void suspend() = 0;
+
+    // Replaces the state with a w*h grid of num_comp planes laid out as by
+    // GridsN::get_state.  Returns false, leaving the state alone, if the model has a
+    // different number of components.
+    virtual bool load_state(int num_comp, int w, int h, const float *src) = 0;
+
+    // Returns false if there is no grid to step yet.
+    virtual bool step() = 0;
+
+    virtual void draw(
+        int w, int h,
+        uint8_t *pixels, int stride, int format, int pal_idx,
+        int dir, Eigen::Vector3f acc
+    ) = 0;
+
+    // One of RdnDiffusionSolver.
+    int diffusion_solver;
+    // Error tolerance for adaptive time stepping, or 0 for the model's fixed get_dt().
+    float time_tolerance;
+    // Step size the adaptive controller will try next (0 if it hasn't run yet).
+    float next_dt;
+    // Reaction time step of the last step().
+    float last_dt;
+    // RMS change of the sampled rows over the last step().
+    float last_change;
+    // Tiles the last step() updated, out of how many (see rdn_set_sparse_threshold).
+    int active_tiles, num_tiles;
+    // Seconds of the current step() spent on each phase, as seen by the first thread.
+    double diffusion_time;
+    double reaction_time;
+    // Whether the state survived the reaction, as seen by the first thread of step_band.
+    bool state_finite;
+};
+
+// The step and draw loops for a model with n components.  Model is the concrete model
+// class (curiously recurring template), which provides
+//
+//     matnn get_diffusion_matrix();
+//     float get_diffusion_norm();
+//     float get_dt();
+//     void compute_dx_dt(const Row<n> &buf, int w, float dt);
+//     vecn get_background_val();
+//     vecn get_seed_val(int seed_idx);
+//     // Range of values each component normally stays within.  Only used to scale the
+//     // int16 storage format, which saturates outside of it.
+//     void get_value_range(vecn &lo, vecn &hi);
+//     // Calls op(palette) with palette number id.
+//     template <typename Op> void with_palette(int id, Op &op);
+//
+// These are resolved at compile time, so the per-row reaction and render_chunk calls can
+// be inlined; the only virtual calls are the FunctionBaseBase entry points, once per
+// evolve() or renderFrame().
+template <int n, typename Model>
+struct FunctionBase : FunctionBaseBase {
+    virtual ~FunctionBase() { }
+
+    Model &self() { return *static_cast<Model *>(this); }
+
+    GridsN<n> *new_grids(int w, int h, int format) {
+        vecn lo, hi;
+        self().get_value_range(lo, hi);
+        return new GridsN<n>(w, h, format, lo, hi);
+    }
+
+    // A copy of the state of old in the given format, without any of the buffers used for
+    // stepping and drawing.
+    GridsN<n> *convert_grids(GridsN<n> *old, int format) {
+        GridsN<n> *gn = new_grids(old->w, old->h, format);
+        Grid<n> line(old->w, 1);
+        for(int y=0; y<old->h; y++) {
+            old->load_row(y, line.get_row(0));
+            gn->store_row(y, line.get_row(0));
+        }
+        return gn;
+    }
+
+    GridsN<n> *get_grids(int w, int h) {
+        bool realloc = !grids || grids->get_n() != n;
+        if(!realloc && w) {
+            realloc |= (grids->w != w);
+            realloc |= (grids->h != h);
+        }
+
+        if(realloc) {
+            if(!w) return NULL;
+            GridsN<n> *gn = new_grids(w, h, storage_format);
+            if(grids && grids->get_n() == n) {
+                // A new size (resolution, rotation or tiling) keeps the pattern.  Source
+                // and destination are both needed while resampling, so the old grid can't
+                // be reused even when the new one would fit in it.
+                GridsN<n> *old = dynamic_cast<GridsN<n> *>(grids);
+                ResampleJob job(old, gn);
+                pool.run(job);
+                delete(old);
+                grids = gn;
+            } else {
+                delete(grids);
+                grids = gn;
+                reset_grid(gn);
+                warm_up_pending = true;
+            }
+        } else if(grids->format != storage_format) {
+            // Carry the state over into the new format (or back from rdn_suspend).
+            GridsN<n> *old = dynamic_cast<GridsN<n> *>(grids);
+            grids = convert_grids(old, storage_format);
+            delete(old);
+        }
+        grids->topology = topology;
+        grids->laplacian = laplacian;
+
+        return dynamic_cast<GridsN<n> *>(grids);
+    }
+
+    // One entry of the sequence of operations that make up a step: either a diffusion
+    // substep with matrix M (the diffusion matrix times the substep length), or a reaction.
+    // Implicit diffusion steps are solved with CyclicSolver rather than applied directly.
+    struct StepOp {
+        bool react;
+        bool implicit;
+        // Time step of a reaction.
+        float dt;
+        float M[n][n];
+    };
+
+    static void push_react(std::vector<StepOp> &ops, float dt) {
+        StepOp op;
+        op.react = true;
+        op.implicit = false;
+        op.dt = dt;
+        ops.push_back(op);
+    }
+
+    // ITERATIONS_PER_STEP iterations of diffusion followed by reaction, each over dt.  With
+    // strang set the iterations are R(dt/2) D(dt) R(dt/2) instead, which is second order in
+    // dt; the half steps of neighbouring iterations are merged, so this costs one extra
+    // reaction.
+    void build_schedule(std::vector<StepOp> &ops, bool implicit, float dt, bool strang) {
+        matnn m = self().get_diffusion_matrix();
+        //Eigen::JacobiSVD<matnn, Eigen::NoQRPreconditioner> svd(m);
+        float diffusion_norm = self().get_diffusion_norm();
+        // An explicit substep is stable while the norm times the largest eigenvalue of the
+        // stencil (8 for the 5-point Laplacian, 16/3 for the 9-point one) is at most 2.
+        float stencil_radius = laplacian == RDN_LAPLACIAN_9_POINT ? 16.0 / 3.0 : 8.0;
+        float diffusion_stability = 2.0 / (diffusion_norm * stencil_radius);
+        diffusion_stability *= 0.95;
+
+        //LOGI("dt=%g, dn=%g, ds=%g", dt, diffusion_norm, diffusion_stability);
+
+        ops.clear();
+        if(strang) push_react(ops, dt/2);
+        for(int iter=0; iter<ITERATIONS_PER_STEP; iter++) {
+            if(implicit) {
+                // Stable for any step, so one solve covers the whole iteration.
+                StepOp op;
+                op.react = false;
+                op.implicit = true;
+                matnn m2 = m * dt;
+                for(int i=0; i<n; i++) for(int j=0; j<n; j++) op.M[i][j] = m2(i, j);
+                ops.push_back(op);
+            }
+            float lap_to_go = implicit ? 0 : dt;
+            while(lap_to_go > 0) {
+                float lap_dt = lap_to_go;
+                if(lap_dt > diffusion_stability) lap_dt = diffusion_stability;
+                matnn m2 = m * lap_dt;
+
+                StepOp op;
+                op.react = false;
+                op.implicit = false;
+                for(int i=0; i<n; i++) for(int j=0; j<n; j++) op.M[i][j] = m2(i, j);
+                ops.push_back(op);
+
+                lap_to_go -= lap_dt;
+            }
+
+            push_react(ops, strang && iter == ITERATIONS_PER_STEP-1 ? dt/2 : dt);
+        }
+    }
+
+    // Adaptive time stepping: the largest reaction step that passes reaction_error(),
+    // starting from the step proposed after the previous evolve() and shrinking it until
+    // it passes.  The diffusion substeps are sized for stability separately, so only the
+    // reaction, which is what blows up when parameters are pushed, is checked.
+    float choose_dt(GridsN<n> *grids) {
+        float nominal = self().get_dt();
+        float min_dt = nominal / MIN_DT_DIVISOR;
+        float max_dt = nominal * MAX_DT_FACTOR;
+        float dt = next_dt > 0 ? next_dt : nominal;
+        dt = std::max(min_dt, std::min(dt, max_dt));
+
+        float q = 0;
+        for(int tries=0; tries<MAX_DT_TRIES; tries++) {
+            q = reaction_error(grids, dt);
+            if(q <= 1 || dt <= min_dt) break;
+            // Both estimates go as dt^2.  NaN means the trial step blew up.
+            float scale = q == q ? 0.9f / sqrtf(q) : 0.2f;
+            dt = std::max(min_dt, dt * std::max(0.2f, std::min(scale, 0.9f)));
+        }
+
+        float grow = q > 0 ? 0.9f / sqrtf(q) : 2.0f;
+        next_dt = dt * std::max(1.0f, std::min(grow, 2.0f));
+        return dt;
+    }
+
+    // Step doubling on the rows sampled by save_probe(): one reaction step of dt against
+    // two of dt/2.  Two things are measured, each relative to its limit, and the larger
+    // is returned (so the step is acceptable if this is at most 1):
+    //
+    //   - the max difference in the state, against time_tolerance;
+    //   - the same for a small perturbation of the state, relative to its size, against
+    //     STIFF_LIMIT.  This is the error of the linearized step, which doesn't vanish
+    //     when the state is close to a fixed point; the first estimate alone would let dt
+    //     grow past the stability limit there until the deviations had grown back.
+    float reaction_error(GridsN<n> *grids, float dt) {
+        const float eps = 1e-3f;
+        int w = grids->w;
+        Grid<n> work(w, 4);
+        Row<n> full = work.get_row(0);
+        Row<n> half = work.get_row(1);
+        Row<n> pfull = work.get_row(2);
+        Row<n> phalf = work.get_row(3);
+        float err = 0;
+        float stiff = 0;
+        for(int k=0; k<grids->num_probe_rows(); k++) {
+            grids->load_probe(k, full);
+            for(int i=0; i<n; i++) {
+                for(int x=0; x<w; x++) {
+                    half.c[i][x] = full.c[i][x];
+                    // Alternate the direction from cell to cell.
+                    float p = full.c[i][x] + (((x + i) & 1) ? eps : -eps);
+                    pfull.c[i][x] = p;
+                    phalf.c[i][x] = p;
+                }
+            }
+            self().compute_dx_dt(full, w, dt);
+            self().compute_dx_dt(half, w, dt/2);
+            self().compute_dx_dt(half, w, dt/2);
+            self().compute_dx_dt(pfull, w, dt);
+            self().compute_dx_dt(phalf, w, dt/2);
+            self().compute_dx_dt(phalf, w, dt/2);
+            for(int i=0; i<n; i++) {
+                for(int x=0; x<w; x++) {
+                    float d = full.c[i][x] - half.c[i][x];
+                    float pd = pfull.c[i][x] - phalf.c[i][x];
+                    float e = fabsf(d);
+                    float s = fabsf(pd - d);
+                    // Written so that NaN is kept.
+                    if(!(e <= err)) err = e;
+                    if(!(s <= stiff)) stiff = s;
+                }
+            }
+        }
+        return std::max(err / time_tolerance, stiff / (eps * STIFF_LIMIT));
+    }
+
+    struct ResampleJob : ThreadPool::Job {
+        ResampleJob(GridsN<n> *_src, GridsN<n> *_dst) :
+            src(_src), dst(_dst), tx(src->w, dst->w), ty(src->h, dst->h) { }
+        void run(int idx, int count) {
+            FlushToZero ftz;
+            dst->resample_rows(src, tx, ty, band_start(dst->h, idx, count),
+                band_start(dst->h, idx+1, count));
+        }
+        GridsN<n> *src;
+        GridsN<n> *dst;
+        ResampleTaps tx, ty;
+    };
+
+    struct StepJob : ThreadPool::Job {
+        StepJob(FunctionBase *_fn, GridsN<n> *_grids, const std::vector<StepOp> &_ops) :
+            fn(_fn), grids(_grids), ops(_ops) { }
+        void run(int idx, int count) {
+            FlushToZero ftz;
+            fn->step_band(grids, ops, idx, count);
+        }
+        FunctionBase *fn;
+        GridsN<n> *grids;
+        const std::vector<StepOp> &ops;
+    };
+
+    struct TileJob : ThreadPool::Job {
+        TileJob(FunctionBase *_fn, GridsN<n> *_grids,
+            const StepOp *_ops, int _num_ops, int _halo, int _tile_h
+        ) :
+            fn(_fn), grids(_grids), ops(_ops), num_ops(_num_ops), halo(_halo), tile_h(_tile_h)
+        { }
+        void run(int idx, int count) {
+            FlushToZero ftz;
+            fn->step_tiles(grids, ops, num_ops, halo, tile_h, idx, count);
+        }
+        FunctionBase *fn;
+        GridsN<n> *grids;
+        const StepOp *ops;
+        int num_ops;
+        int halo;
+        int tile_h;
+    };
+
+    bool step() {
+        GridsN<n> *grids = get_grids(0, 0);
+        if(!grids) return false;
+
+        double t0 = perf_now();
+        diffusion_time = 0;
+        reaction_time = 0;
+
+        // Implicit solves need the whole of each row and column, so they aren't available
+        // with tiles, which is the only way a compact grid can be stepped.
+        bool implicit = diffusion_solver == RDN_DIFFUSION_IMPLICIT && !grids->is_compact();
+
+        grids->save_probe();
+
+        bool adaptive = time_tolerance > 0;
+        float dt = adaptive ? choose_dt(grids) : self().get_dt();
+        last_dt = dt;
+
+        std::vector<StepOp> ops;
+        build_schedule(ops, implicit, dt, adaptive);
+        grids->reserve_band_buffers(pool.get_num_threads());
+
+        bool blocked = !implicit && (temporal_blocking || grids->is_compact());
+        bool sparse = !implicit && !blocked && can_skip_quiet(ops);
+        if(sparse) {
+            float val[n];
+            vecn bg = self().get_background_val();
+            for(int i=0; i<n; i++) val[i] = bg[i];
+            active_tiles = grids->plan_active(val, sparse_threshold);
+        } else {
+            active_tiles = grids->set_all_active();
+        }
+        num_tiles = grids->tiles_x() * grids->tiles_y();
+
+        if(implicit) {
+            // Every iteration uses the same matrix.
+            const StepOp *op = &ops[0];
+            while(!op->implicit) op++;
+            solve_rows.prepare(op->M, grids->row_line_length());
+            solve_column_pairs.prepare(op->M, 2*grids->h);
+            solve_single_column.prepare(op->M, grids->h);
+        }
+
+        // Memory traffic: a blocked pass reads and writes the state once, as stored; the
+        // banded sweep reads and writes it (as floats) for every op, twice for implicit
+        // diffusion, which sweeps rows and then columns.
+        double state = grids->state_bytes();
+        double diffusion_bytes = 0;
+        double reaction_bytes = 0;
+        double step_bytes;
+        int passes;
+        if(blocked && (passes = step_blocked(grids, ops))) {
+            step_bytes = 2 * state * passes;
+            // A pass moves the state once for all of its ops, so the phases get shares of
+            // the traffic in proportion to their ops.
+            int reactions = 0;
+            for(size_t i=0; i<ops.size(); i++) {
+                if(ops[i].react) reactions++;
+            }
+            reaction_bytes = step_bytes * reactions / ops.size();
+            diffusion_bytes = step_bytes - reaction_bytes;
+        } else {
+            // Bands need at least one row each.
+            grids->set_num_bands(std::min(pool.get_num_threads(), grids->h));
+
+            StepJob job(this, grids, ops);
+            pool.run(job);
+
+            // Counting the stepped tiles as full ones.
+            double touched = state * active_tiles / num_tiles;
+            for(size_t i=0; i<ops.size(); i++) {
+                if(ops[i].react) {
+                    reaction_bytes += 2 * touched;
+                } else {
+                    diffusion_bytes += (ops[i].implicit ? 4 : 2) * touched;
+                }
+            }
+            step_bytes = diffusion_bytes + reaction_bytes;
+        }
+
+        last_change = grids->probe_change();
+
+        record_phase(RDN_PHASE_STEP, (perf_now() - t0) * 1e3, step_bytes);
+        record_phase(RDN_PHASE_DIFFUSION, diffusion_time * 1e3, diffusion_bytes);
+        record_phase(RDN_PHASE_REACTION, reaction_time * 1e3, reaction_bytes);
+        return true;
+    }
+
+    // Whether step() may skip quiet tiles (see GridsN::plan_active): sparse stepping is on,
+    // the schedule has no more diffusion substeps than a tile is wide, and the background
+    // is a fixed point of the reaction, one reaction step moving it by no more than a
+    // hundredth of the threshold.
+    bool can_skip_quiet(const std::vector<StepOp> &ops) {
+        if(!(sparse_threshold > 0)) return false;
+        int substeps = 0;
+        for(size_t i=0; i<ops.size(); i++) substeps += !ops[i].react;
+        if(substeps > ACTIVE_TILE) return false;
+
+        vecn bg = self().get_background_val();
+        Grid<n> line(1, 1);
+        Row<n> row = line.get_row(0);
+        row.set(0, bg);
+        self().compute_dx_dt(row, 1, self().get_dt());
+        // Written so that NaN fails.
+        return (row[0] - bg).cwiseAbs().maxCoeff() <= sparse_threshold * 0.01f;
+    }
+
+    // The body of step() for one thread.  Every thread walks through the same sequence of
+    // phases, with barriers in between, and only touches its own band of rows.
+    void step_band(GridsN<n> *grids, const std::vector<StepOp> &ops, int band, int count) {
+        int h = grids->h;
+        bool active = band < grids->get_num_bands();
+        int y0 = band_start(h, band, grids->get_num_bands());
+        int y1 = band_start(h, band+1, grids->get_num_bands());
+
+        for(size_t op=0; op<ops.size(); op++) {
+            double t0 = band == 0 ? perf_now() : 0;
+
+            if(ops[op].implicit) {
+                if(active) grids->implicit_rows(solve_rows, band, y0, y1);
+                pool.barrier();
+                grids->implicit_columns(solve_column_pairs, solve_single_column, band, count);
+                pool.barrier();
+                if(band == 0) diffusion_time += perf_now() - t0;
+                continue;
+            }
+
+            if(!ops[op].react) {
+                if(active) grids->save_band_edges(band);
+                pool.barrier();
+                if(active) grids->diffuse_band(ops[op].M, band);
+                pool.barrier();
+                if(band == 0) diffusion_time += perf_now() - t0;
+                continue;
+            }
+
+            if(active) {
+                for(int y=y0; y<y1; y++) {
+                    const int *sp;
+                    int num_spans = grids->row_spans(y, sp);
+                    for(int k=0; k<num_spans; k++) {
+                        self().compute_dx_dt(grids->gridA->get_row(y).offset(sp[2*k]),
+                            sp[2*k+1] - sp[2*k], ops[op].dt);
+                    }
+                }
+            }
+            // is_finite() looks at a cell of the first band, so that thread decides for all
+            // of them.  Asking after the barrier would race with its reset, and a thread
+            // that saw the new grid would skip the barrier below.
+            if(band == 0) state_finite = grids->is_finite();
+            pool.barrier();
+
+            if(!state_finite) {
+                if(band == 0) reset_grid(grids);
+                pool.barrier();
+            }
+            if(band == 0) reaction_time += perf_now() - t0;
+        }
+
+        int th = grids->tiles_y();
+        grids->update_quiet(band_start(th, band, count), band_start(th, band+1, count));
+    }
+
+    // Runs the schedule as temporally blocked passes.  Each pass covers whole iterations,
+    // as many as fit in MAX_TILE_HALO substeps.  Returns the number of passes, or 0 (having
+    // done nothing) if the substeps don't fit or the grid is too short for the halo, in
+    // which case the plain banded sweep is used.  A compact grid can't be swept in place,
+    // so it gets one pass per op instead.
+    int step_blocked(GridsN<n> *grids, const std::vector<StepOp> &ops) {
+        int h = grids->h;
+        int row_bytes = n * grids->w * sizeof(float);
+
+        // Split into passes at reaction boundaries.
+        std::vector<int> pass_end;
+        int halo = 0;
+        int max_halo = 0;
+        int iter_subs = 0;
+        for(size_t i=0; i<ops.size(); i++) {
+            if(!ops[i].react) {
+                iter_subs++;
+                continue;
+            }
+            if(iter_subs > MAX_TILE_HALO || iter_subs*4 > h) {
+                if(!grids->is_compact()) return 0;
+                pass_end.clear();
+                for(size_t j=1; j<ops.size(); j++) pass_end.push_back(j);
+                max_halo = 1;
+                break;
+            }
+            if(halo + iter_subs > MAX_TILE_HALO) {
+                pass_end.push_back(i - iter_subs);
+                halo = 0;
+            }
+            halo += iter_subs;
+            max_halo = std::max(max_halo, halo);
+            iter_subs = 0;
+        }
+        pass_end.push_back(ops.size());
+
+        int tile_h = std::max(2*max_halo, TILE_BYTES / row_bytes - 2*max_halo);
+        tile_h = std::max(tile_h, 8);
+
+        int op0 = 0;
+        for(size_t p=0; p<pass_end.size(); p++) {
+            int op1 = pass_end[p];
+            int pass_halo = 0;
+            for(int i=op0; i<op1; i++) {
+                if(!ops[i].react) pass_halo++;
+            }
+            grids->alloc_back_grid();
+            TileJob job(this, grids, &ops[op0], op1-op0, pass_halo, tile_h);
+            pool.run(job);
+            grids->swap_back_grid();
+            op0 = op1;
+
+            if(!grids->is_finite()) {
+                reset_grid(grids);
+            }
+        }
+        return pass_end.size();
+    }
+
+    // One thread's share of a temporally blocked pass.  Tiles of tile_h rows are loaded
+    // from the state together with halo rows on either side, run through all the ops, and
+    // the middle is written to the back grid.  Each diffusion substep invalidates one more
+    // row at each edge of the tile, which is why the halo is as deep as the number of
+    // substeps.
+    void step_tiles(GridsN<n> *grids, const StepOp *ops, int num_ops, int halo, int tile_h,
+        int band, int count
+    ) {
+        int w = grids->w;
+        int h = grids->h;
+        int y0 = band_start(h, band, count);
+        int y1 = band_start(h, band+1, count);
+
+        int tile_rows = tile_h + 2*halo;
+        Grid<n> *tile = grids->get_tile(band, tile_rows + 2);
+        Row<n> prev = tile->get_row(tile_rows);
+        Row<n> cur  = tile->get_row(tile_rows+1);
+
+        for(int s0=y0; s0<y1; s0+=tile_h) {
+            int s1 = std::min(s0+tile_h, y1);
+            int rows = s1 - s0 + 2*halo;
+            for(int r=0; r<rows; r++) {
+                grids->load_row_wrapped(s0 - halo + r, tile->get_row(r));
+            }
+
+            int lo = 0;
+            int hi = rows;
+            for(int op=0; op<num_ops; op++) {
+                double t0 = band == 0 ? perf_now() : 0;
+                if(ops[op].react) {
+                    for(int r=lo; r<hi; r++) {
+                        self().compute_dx_dt(tile->get_row(r), w, ops[op].dt);
+                    }
+                    if(band == 0) reaction_time += perf_now() - t0;
+                } else {
+                    lo++;
+                    hi--;
+                    grids->diffuse_tile_rows(ops[op].M, *tile, lo, hi, prev, cur);
+                    if(band == 0) diffusion_time += perf_now() - t0;
+                }
+            }
+
+            for(int y=s0; y<s1; y++) {
+                grids->store_row(y, tile->get_row(y - s0 + halo), true);
+            }
+        }
+    }
+
+    void reset_grid() {
+        GridsN<n> *grids = get_grids(0, 0);
+        if(!grids) return;
+        reset_grid(grids);
+    }
+
+    void reset_grid(GridsN<n> *grids) {
+        int w = grids->w;
+        int h = grids->h;
+
+        const int num_seeds = 20;
+        const int sr = 20;
+        vecn seedval[num_seeds];
+        int seed_x[num_seeds], seed_y[num_seeds];
+        for(int seed_idx = 0; seed_idx < num_seeds; seed_idx++) {
+            seedval[seed_idx] = self().get_seed_val(seed_idx);
+            seed_x[seed_idx] = rand() % (w - sr);
+            seed_y[seed_idx] = rand() % (h - sr);
+        }
+
+        // Built a row at a time, since the state may be in a compact format.
+        vecn background = self().get_background_val();
+        Grid<n> line(w, 1);
+        Row<n> buf = line.get_row(0);
+        for(int y = 0; y < h; y++) {
+            for(int x = 0; x < w; x++) {
+                buf.set(x, background);
+            }
+            for(int seed_idx = 0; seed_idx < num_seeds; seed_idx++) {
+                int y0 = seed_y[seed_idx];
+                if(y < y0 || y >= y0+sr) continue;
+                int x0 = seed_x[seed_idx];
+                for(int x = x0; x < x0+sr; x++) {
+                    buf.set(x, seedval[seed_idx]);
+                }
+            }
+            grids->store_row(y, buf);
+        }
+        grids->clear_quiet();
+
+        // The adaptive step starts over from get_dt().
+        next_dt = 0;
+    }
+
+    void suspend() {
+        GridsN<n> *old = dynamic_cast<GridsN<n> *>(grids);
+        if(!old) return;
+        // Params outside the usual ones can take the state beyond get_value_range, which
+        // int16 would clip.  fp16 takes the same memory and keeps the range.
+        vecn lo, hi;
+        self().get_value_range(lo, hi);
+        int format = old->in_range(lo, hi) ? RDN_STORAGE_INT16 : RDN_STORAGE_FP16;
+        grids = convert_grids(old, format);
+        delete(old);
+    }
+
+    bool load_state(int num_comp, int w, int h, const float *src) {
+        if(num_comp != n) return false;
+        GridsN<n> *gn = new_grids(w, h, storage_format);
+        gn->set_state(src);
+        delete(grids);
+        grids = gn;
+        // Sets the topology and stencil.
+        get_grids(0, 0);
+        next_dt = 0;
+        return true;
+    }
+
+    void draw(
+        int w, int h,
+        uint8_t *pixels, int stride, int format, int pal_idx,
+        int dir, Eigen::Vector3f acc
+    ) {
+        double t0 = perf_now();
+        GridsN<n> *grids = sim_running ? latest_state(w, h, dir) : get_grids(w, h);
+        if(!grids) return;
+
+        DrawOp op;
+        op.fn = this;
+        op.grids = grids;
+        op.pixels = pixels;
+        op.stride = stride;
+        op.format = format;
+        op.dir = dir;
+        op.acc = acc;
+        self().with_palette(pal_idx, op);
+
+        double ms = (perf_now() - t0) * 1e3;
+        record_phase(RDN_PHASE_RENDER, ms,
+            grids->state_bytes() + (double)w * h * rdn_pixel_size(format));
+        pthread_mutex_lock(&stats_mutex);
+        unreported_render_ms += ms;
+        pthread_mutex_unlock(&stats_mutex);
+
+#if 0
+        static int print_interval = 0;
+        if((print_interval++) % 20 == 0) {
+            Grid<n> rows(w, 6);
+            vecn minA, maxA, minL, maxL;
+            for(int y=0; y<h; y++) {
+                Row<n> up = grids->view_row_wrapped(y-1, rows.get_row(0));
+                Row<n> bufA = grids->view_row_wrapped(y, rows.get_row(1));
+                Row<n> dn = grids->view_row_wrapped(y+1, rows.get_row(2));
+                Row<n> bufL = rows.get_row(3);
+                grids->derivative_row(up, bufA, dn, rows.get_row(4), rows.get_row(5), &bufL);
+                if(y == 0) {
+                    minA = maxA = bufA[0];
+                    minL = maxL = bufL[0];
+                }
+                for(int x=0; x<w; x++) {
+                    minA = minA.cwiseMin(bufA[x]);
+                    maxA = maxA.cwiseMax(bufA[x]);
+                    minL = minL.cwiseMin(bufL[x]);
+                    maxL = maxL.cwiseMax(bufL[x]);
+                }
+            }
+            for(int c=0; c<n; c++) {
+                LOGI("A[%d] range [%f,%f]", c, minA[c], maxA[c]);
+            }
+            for(int c=0; c<n; c++) {
+                LOGI("L[%d] range [%f,%f]", c, minL[c], maxL[c]);
+            }
+        }
+#endif
+    }
+
+    // The state last published by the simulation thread.  The lower tile is drawn right
+    // after the upper one and has to match it, so it doesn't move on to a newer state
+    // (unless only lower tiles are being drawn).  If there is no state of this size (or
+    // number of components) yet, the thread is held up to make one.
+    GridsN<n> *latest_state(int w, int h, int dir) {
+        if(!(dir && last_render_dir == 0)) snapshots.update();
+        last_render_dir = dir;
+        GridsN<n> *gn = dynamic_cast<GridsN<n> *>(snapshots.read_slot());
+        if(gn && gn->w == w && gn->h == h) return gn;
+        {
+            SimLock lock;
+            if(get_grids(w, h)) publish_state();
+        }
+        snapshots.update();
+        return dynamic_cast<GridsN<n> *>(snapshots.read_slot());
+    }
+
+    // Passes the palette chosen by with_palette() on to draw_with().
+    struct DrawOp {
+        template <typename Pal>
+        void operator()(Pal &pal) {
+            fn->draw_with(pal, grids, pixels, stride, format, dir, acc);
+        }
+
+        FunctionBase *fn;
+        GridsN<n> *grids;
+        uint8_t *pixels;
+        int stride;
+        int format;
+        int dir;
+        Eigen::Vector3f acc;
+    };
+
+    template <typename Pal>
+    void draw_with(Pal &pal, GridsN<n> *grids,
+        uint8_t *pixels, int stride, int format, int dir, const Eigen::Vector3f &acc
+    ) {
+        pal.fold_colors();
+
+        DrawJob<Pal> job;
+        job.grids = grids;
+        job.pal = &pal;
+        job.pixels = pixels;
+        job.stride = stride;
+        job.format = format;
+        job.dir = dir;
+        job.acc = acc;
+        // While the simulation thread runs the pool is busy stepping.
+        int threads = sim_running ? 1 : pool.get_num_threads();
+        std::vector<double> gradient_time(threads);
+        job.gradient_time = &gradient_time[0];
+        grids->reserve_band_buffers(threads);
+        if(sim_running) {
+            job.run(0, 1);
+        } else {
+            pool.run(job);
+        }
+
+        double total = 0;
+        for(int i=0; i<threads; i++) total += gradient_time[i];
+        record_phase(RDN_PHASE_GRADIENT, total / threads * 1e3, grids->state_bytes());
+    }
+
+    // Rendering is split into row bands too.  Each thread streams through its band with a
+    // window of three rows of the state, and computes the gradient and Laplacian of the
+    // middle one just before rendering it.  Float rows are read in place; compact ones,
+    // and the mirrored rows past the top and bottom edges, are decoded into the window's
+    // own buffers.
+    template <typename Pal>
+    struct DrawJob : ThreadPool::Job {
+        void run(int idx, int count) {
+            FlushToZero ftz;
+            int h = grids->h;
+            int y0 = band_start(h, idx, count);
+            int y1 = band_start(h, idx+1, count);
+            gradient_time[idx] = 0;
+            if(y0 >= y1) return;
+
+            Grid<n> *rows = grids->get_band_buffer(grids->render_rows, idx, 6);
+            Row<n> buf_up  = rows->get_row(0);
+            Row<n> buf_cur = rows->get_row(1);
+            Row<n> buf_dn  = rows->get_row(2);
+            Row<n> bufL  = rows->get_row(3);
+            Row<n> bufDX = rows->get_row(4);
+            Row<n> bufDY = rows->get_row(5);
+            Row<n> up  = grids->view_row_wrapped(y0-1, buf_up);
+            Row<n> cur = grids->view_row_wrapped(y0, buf_cur);
+            for(int y = y0; y < y1; y++) {
+                Row<n> dn = grids->view_row_wrapped(y+1, buf_dn);
+                double t0 = perf_now();
+                grids->derivative_row(up, cur, dn, bufDX, bufDY,
+                    Pal::needs_laplacian ? &bufL : NULL);
+                gradient_time[idx] += perf_now() - t0;
+                render_row(y, cur, bufL, bufDX, bufDY);
+                // The buffer of the row that drops out of the window takes the next one.
+                up = cur;
+                cur = dn;
+                Row<n> tmp = buf_up;
+                buf_up = buf_cur;
+                buf_cur = buf_dn;
+                buf_dn = tmp;
+            }
+        }
+
+        void render_row(int y, const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY
+        ) {
+            int w = grids->w;
+            int bpp = rdn_pixel_size(format);
+            int pix_step = dir ? -1 : 1;
+            uint8_t *pix_line = pixels + y * stride;
+            if(dir) pix_line += bpp*(w-1);
+            EmitFn emit = simd_kernels().emit[format][Pal::num_features];
+            RenderChunk ch;
+            for(int x = 0; x < w; x += RENDER_CHUNK) {
+                int cnt = std::min(RENDER_CHUNK, w - x);
+                pal->render_chunk(bufA, bufL, bufDX, bufDY, x, cnt, acc, ch);
+                emit(ch.f, pal->folded, pix_line + x*pix_step*bpp, cnt, pix_step, x, y);
+            }
+        }
+
+        GridsN<n> *grids;
+        Pal *pal;
+        uint8_t *pixels;
+        int stride;
+        int format;
+        int dir;
+        Eigen::Vector3f acc;
+        // Seconds each thread spent on derivative_row().
+        double *gradient_time;
+    };
+
+    CyclicSolver<n> solve_rows;
+    CyclicSolver<n> solve_column_pairs;
+    CyclicSolver<n> solve_single_column;
+};
+
+struct GinzburgLandau : public FunctionBase<2, GinzburgLandau> {
+    static const int n = 2;
+
+    GinzburgLandau() :
+        D(2.0F),
+        alpha(0.0625F),
+        beta (1.0F   ),
+        pal_gl0(new PaletteGL0(*this)),
+        pal_gl1(new PaletteGL1(*this)),
+        pal_gl2(new PaletteGL2(*this))
+    { }
+
+    ~GinzburgLandau() {
+        delete(pal_gl0);
+        delete(pal_gl1);
+        delete(pal_gl2);
+    }
+
+    vecn get_background_val() {
+        vecn ret;
+        ret << 1, 0;
+        return ret;
+    }
+
+    void get_value_range(vecn &lo, vecn &hi) {
+        // The field relaxes onto the unit circle; seeds start out inside [-1,1]^2.
+        lo << -1.5f, -1.5f;
+        hi <<  1.5f,  1.5f;
+    }
+
+    vecn get_seed_val(int seed_idx) {
+        float U = ((seed_idx*5)%7)/7.0F*2.0F-1.0F;
+        float V = ((seed_idx*9)%13)/13.0F*2.0F-1.0F;
+        vecn ret;
+        ret << U, V;
+        return ret;
+    }
+
+    virtual void set_params(const float *p, int len) {
+        if(len != 3) {
+            LOGE("params is wrong length: %d", len);
+        }
+        D     = *(p++);
+        alpha = *(p++);
+        beta  = *(p++);
+        D2 = D*D;
+    }
+
+    matnn get_diffusion_matrix() {
+        matnn ret;
+        ret << D, -D*alpha, D*alpha, D;
+        return ret;
+    }
+
+    float get_diffusion_norm() {
+        // This seems to be appropriate, but I don't know exactly why.
+        return D * (1 + fabsf(alpha*alpha));
+    }
+
+    float get_dt() {
+        // This seems to be appropriate, but I don't know exactly why.
+        //return 0.5 / std::max(5.0f, fabsf(beta*beta));
+        return 0.1;
+    }
+
+    void compute_dx_dt(const Row<n> &buf, int w, float dt) {
+        // For each pixel:
+        //     r2 = U*U + V*V
+        //     U += dt * U*(1-r2)
+        //     V += dt * V*(1-r2)
+        //     (U, V) rotated by the angle t = dt*beta*r2 (to second order)
+        // See react_ginzburg_landau_kernel().
+        //buf[x][0] += dt * (U - (U - beta*V)*r2);
+        //buf[x][1] += dt * (V - (V + beta*U)*r2);
+        simd_kernels().react_ginzburg_landau(buf.c[0], buf.c[1], w, dt, beta);
+    }
+
+    struct PaletteGL0 : public Palette<n> {
+        PaletteGL0(GinzburgLandau &x) : parent(x) {
+            set_feature(0, 1, 0, 0);
+            set_feature(1, 0, 0, 1);
+            set_feature(2, 100.0f, 100.0f, 100.0f);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 3 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_R2(bufA, bufDX, bufDY, x, cnt, acc, ch);
+            const float *U = bufA.c[0] + x, *V = bufA.c[1] + x;
+            const float *LU = bufL.c[0] + x, *LV = bufL.c[1] + x;
+            float *red = ch.buf[0], *blue = ch.buf[1];
+            for(int i = 0; i < cnt; i++) {
+                float lv = parent.D2 * (LU[i]*LU[i] + LV[i]*LV[i]);
+                float rv = U[i]*U[i] + V[i]*V[i];
+                red[i]  = std::max((1.0f-rv) * 500.0f * ch.dp[i], 0.0f);
+                blue[i] = std::max(lv * 4000.0f * ch.dp[i] - red[i], 0.0f);
+            }
+            ch.f[0] = red;
+            ch.f[1] = blue;
+            ch.f[2] = ch.spec;
+        }
+
+        GinzburgLandau &parent;
+    };
+
+    struct PaletteGL1 : public Palette<n> {
+        PaletteGL1(GinzburgLandau &x) : parent(x) {
+            set_feature(0, 0, 70.0f, 70.0f);
+            set_feature(1, 0, -500.0f, 0);
+            set_feature(2, 0, 0, -500.0f);
+            set_feature(3, 200.0f, 200.0f, 200.0f);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 4 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_cross(bufA, bufDX, bufDY, x, cnt, acc, ch);
+            const float *U = bufA.c[0] + x, *V = bufA.c[1] + x;
+            const float *LU = bufL.c[0] + x, *LV = bufL.c[1] + x;
+            float *rotA = ch.buf[0], *rotB = ch.buf[1];
+            for(int i = 0; i < cnt; i++) {
+                float lU = LU[i] * parent.D;
+                float lV = LV[i] * parent.D;
+                rotA[i] = (U[i]*lV - V[i]*lU) * ch.dp[i];
+                rotB[i] = (U[i]*lU + V[i]*lV) * ch.dp[i];
+            }
+            ch.f[0] = ch.dp;
+            ch.f[1] = rotA;
+            ch.f[2] = rotB;
+            ch.f[3] = ch.spec;
+        }
+
+        GinzburgLandau &parent;
+    };
+
+    struct PaletteGL2 : public Palette<n> {
+        PaletteGL2(GinzburgLandau &x) : parent(x) {
+            set_feature(0, 0, 150.0f, 0);
+            set_feature(1, 150.0f, 150.0f, 150.0f);
+            set_constant(0, 25.0f, 0);
+        }
+
+        enum { num_features = 2 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_R2(bufA, bufDX, bufDY, x, cnt, acc, ch);
+            ch.f[0] = ch.dp;
+            ch.f[1] = ch.spec;
+        }
+
+        GinzburgLandau &parent;
+    };
+
+    template <typename Op>
+    void with_palette(int id, Op &op) {
+        switch(id) {
+            case 1: op(*pal_gl1); break;
+            case 2: op(*pal_gl2); break;
+            default: op(*pal_gl0); break;
+        }
+    }
+
+    float D, D2, alpha, beta;
+    PaletteGL0 *pal_gl0;
+    PaletteGL1 *pal_gl1;
+    PaletteGL2 *pal_gl2;
+};
+
+struct GinzburgLandauQ : public FunctionBase<4, GinzburgLandauQ> {
+    static const int n = 4;
+
+    GinzburgLandauQ() :
+        D(2.0F),
+        alpha(0.0625F),
+        beta (1.0F   ),
+        pal_gl0(new PaletteGL0(*this)),
+        pal_gl1(new PaletteGL1(*this))
+    {
+        update_matrices();
+    }
+
+    ~GinzburgLandauQ() {
+        delete(pal_gl0);
+        delete(pal_gl1);
+    }
+
+    vecn get_background_val() {
+        vecn ret;
+        ret << 1, 0, 0, 0;
+        return ret;
+    }
+
+    vecn get_seed_val(int seed_idx) {
+        vecn ret;
+        ret <<
+            ((seed_idx*5)%7)/7.0F*2.0F-1.0F,
+            ((seed_idx*9)%13)/13.0F*2.0F-1.0F,
+            ((seed_idx*11)%17)/17.0F*2.0F-1.0F,
+            ((seed_idx*9)%5)/5.0F*2.0F-1.0F;
+        return get_background_val() + ret;
+    }
+
+    void get_value_range(vecn &lo, vecn &hi) {
+        lo.setConstant(-2.5f);
+        hi.setConstant( 2.5f);
+    }
+
+    static inline matnn quat_to_mat(float aw, float ax, float ay, float az) {
+        matnn ret;
+        ret <<
+            aw, -ax, -ay, -az,
+            ax,  aw,  az, -ay,
+            ay, -az,  aw,  ax,
+            az,  ay, -ax,  aw;
+        return ret;
+    }
+
+    virtual void set_params(const float *p, int len) {
+        if(len != 3) {
+            LOGE("params is wrong length: %d", len);
+        }
+        D     = *(p++);
+        alpha = *(p++);
+        beta  = *(p++);
+        update_matrices();
+    }
+
+    void update_matrices() {
+        float theta = (float)(M_PI / 180.0) * 15.0f;
+
+        D2 = D*D;
+        dmat = D * quat_to_mat(1.0f, alpha, 0.0f, 0.0f);
+        fmat = quat_to_mat(0.0f, sinf(theta), cosf(theta), 0.0f);
+        for(int i=0; i<n; i++) for(int j=0; j<n; j++) fmat_rows[i*n+j] = fmat(i, j);
+    }
+
+    matnn get_diffusion_matrix() {
+        return dmat;
+    }
+
+    float get_diffusion_norm() {
+        // This seems to be appropriate, but I don't know exactly why.
+        return D * (1 + fabsf(alpha*alpha));
+    }
+
+    float get_dt() {
+        // This seems to be appropriate, but I don't know exactly why.
+        //return 0.3 / std::max(5.0f, fabsf(beta*beta));
+        return 0.05;
+    }
+
+    void compute_dx_dt(const Row<n> &buf, int w, float dt) {
+        // For each pixel:
+        //     r2 = |v|^2
+        //     v += dt * v*(1-r2)
+        //     v rotated by the angle t = dt*beta*r2 about fmat (to second order):
+        //     v = v*(1-t*t/2) - fmat*v*t
+        // See react_ginzburg_landau_q_kernel().
+        //fmat = quat_to_mat(0.0f, 0.0f, beta, 0.0f);
+        //v += dt * (v - r2 * (fmat * v));
+        simd_kernels().react_ginzburg_landau_q(buf.c, w, dt, beta, fmat_rows);
+    }
+
+    struct PaletteGL0 : public Palette<n> {
+        PaletteGL0(GinzburgLandauQ &x) : parent(x) {
+            set_feature(0, 0, 150.0f, 0);
+            set_feature(1, 50.0f, 50.0f, 50.0f);
+            set_constant(0, 25.0f, 0);
+        }
+
+        enum { num_features = 2 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_R2(bufA, bufDX, bufDY, x, cnt, acc, ch);
+            ch.f[0] = ch.dp;
+            ch.f[1] = ch.spec;
+        }
+
+        GinzburgLandauQ &parent;
+    };
+
+    struct PaletteGL1 : public Palette<n> {
+        PaletteGL1(GinzburgLandauQ &x) : parent(x) {
+            set_feature(0, 100.0f, 0, 0);
+            set_feature(1, 500.0f, 0, 500.0f);
+            set_feature(2, 50.0f, 50.0f, 50.0f);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 3 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_R2(bufA, bufDX, bufDY, x, cnt, acc, ch);
+            float *rv = ch.buf[0], *lv = ch.buf[1];
+            for(int i = 0; i < cnt; i++) {
+                float r2 = 0, l2 = 0;
+                for(int j = 0; j < n; j++) {
+                    r2 += bufA.c[j][x+i] * bufA.c[j][x+i];
+                    l2 += bufL.c[j][x+i] * bufL.c[j][x+i];
+                }
+                rv[i] = r2 * ch.dp[i];
+                lv[i] = parent.D2 * l2 * ch.dp[i];
+            }
+            ch.f[0] = rv;
+            ch.f[1] = lv;
+            ch.f[2] = ch.spec;
+        }
+
+        GinzburgLandauQ &parent;
+    };
+
+    template <typename Op>
+    void with_palette(int id, Op &op) {
+        switch(id) {
+            case 1: op(*pal_gl1); break;
+            default: op(*pal_gl0); break;
+        }
+    }
+
+    float D, D2, alpha, beta;
+    matnn fmat, dmat;
+    // fmat, row-major, for the reaction kernel.
+    float fmat_rows[n*n];
+    PaletteGL0 *pal_gl0;
+    PaletteGL1 *pal_gl1;
+};
+
+struct GrayScott : public FunctionBase<2, GrayScott> {
+    static const int n = 2;
+
+    GrayScott() :
+        D(2.0F),
+        F(0.01F),
+        k(0.049F),
+        pal_gs0(new PaletteGS0(*this)),
+        pal_gs1(new PaletteGS1(*this)),
+        pal_gs2(new PaletteGS2(*this))
+    { }
+
+    ~GrayScott() {
+        delete(pal_gs0);
+        delete(pal_gs1);
+        delete(pal_gs2);
+    }
+
+    vecn get_background_val() {
+        vecn ret;
+        ret << 1, 0;
+        return ret;
+    }
+
+    void get_value_range(vecn &lo, vecn &hi) {
+        // The concentrations settle within [0,1], but overshoot while the seeds dissolve
+        // (B up to about 1.5, A down to about -0.15).
+        lo << -0.25f, -0.25f;
+        hi <<  1.25f,  1.75f;
+    }
+
+    vecn get_seed_val(int seed_idx) {
+        //get_background_val(A, B);
+        //switch(seed_idx % 2) {
+        //    case 0:  A += 0.0F; B += 0.1F; break;
+        //    default: A += 0.1F; B += 0.0F; break;
+        //}
+        float A = ((seed_idx*5)%7)/7.0F;
+        float B = ((seed_idx*9)%13)/13.0F;
+        vecn ret;
+        ret << A, B;
+        return ret;
+    }
+
+    virtual void set_params(const float *p, int len) {
+        if(len != 3) {
+            LOGE("params is wrong length: %d", len);
+        }
+        D = p[0];
+        F = p[1];
+        k = p[2];
+    }
+
+    matnn get_diffusion_matrix() {
+        matnn ret;
+        ret << 2*D, 0, 0, D;
+        return ret;
+    }
+
+    float get_diffusion_norm() {
+        return 2*D;
+    }
+
+    float get_dt() {
+        return 1.5;
+    }
+
+    void compute_dx_dt(const Row<n> &buf, int w, float dt) {
+        // a += dt * (-a*b*b + F*(1-a))
+        // b += dt * ( a*b*b - (F+k)*b)
+        simd_kernels().react_gray_scott(buf.c[0], buf.c[1], w, dt, F, k);
+    }
+
+    struct PaletteGS0 : public Palette<n> {
+        PaletteGS0(GrayScott &x) : parent(x) {
+            set_feature(0, 150.0f, 0, 0);
+            set_feature(1, 0, 0, 30000.0f);
+            set_feature(2, 50.0f, 50.0f, 50.0f);
+        }
+
+        enum { num_features = 3 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_A(bufDX, bufDY, x, cnt, acc, ch);
+            const float *A = bufA.c[0] + x, *B = bufA.c[1] + x;
+            float *fa = ch.buf[0], *fb = ch.buf[1];
+            float F = parent.F;
+            for(int i = 0; i < cnt; i++) {
+                fa[i] = (1.0f-A[i]) * ch.dp[i];
+                fb[i] = (A[i]*B[i]*B[i] - F*(1.0f-A[i])) * ch.dp[i];
+            }
+            ch.f[0] = fa;
+            ch.f[1] = fb;
+            ch.f[2] = ch.spec;
+        }
+
+        GrayScott &parent;
+    };
+
+    struct PaletteGS1 : public Palette<n> {
+        PaletteGS1(GrayScott &x) : parent(x) {
+            set_feature(0, 64.0f, 0, 64.0f);
+            set_feature(1, 100000.0f, 0, 0);
+            set_feature(2, 0, 0, 60000.0f);
+            set_feature(3, 50.0f, 50.0f, 50.0f);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 4 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_A(bufDX, bufDY, x, cnt, acc, ch);
+            const float *LA = bufL.c[0] + x, *LB = bufL.c[1] + x;
+            float *fa = ch.buf[0], *fb = ch.buf[1];
+            float D = parent.D;
+            for(int i = 0; i < cnt; i++) {
+                fb[i] = D * LB[i] * ch.dp[i];
+                fa[i] = D * LA[i] * ch.dp[i];
+            }
+            ch.f[0] = ch.dp;
+            ch.f[1] = fb;
+            ch.f[2] = fa;
+            ch.f[3] = ch.spec;
+        }
+
+        GrayScott &parent;
+    };
+
+    struct PaletteGS2 : public Palette<n> {
+        PaletteGS2(GrayScott &x) : parent(x) {
+            set_feature(0, 0, 150.0f, 0);
+            set_feature(1, 50.0f, 50.0f, 50.0f);
+            set_constant(0, 25.0f, 0);
+        }
+
+        enum { num_features = 2 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_A(bufDX, bufDY, x, cnt, acc, ch);
+            ch.f[0] = ch.dp;
+            ch.f[1] = ch.spec;
+        }
+
+        GrayScott &parent;
+    };
+
+    template <typename Op>
+    void with_palette(int id, Op &op) {
+        switch(id) {
+            case 1: op(*pal_gs1); break;
+            case 2: op(*pal_gs2); break;
+            default: op(*pal_gs0); break;
+        }
+    }
+
+    float D, F, k;
+    PaletteGS0 *pal_gs0;
+    PaletteGS1 *pal_gs1;
+    PaletteGS2 *pal_gs2;
+};
+
+struct WackerScholl : public FunctionBase<2, WackerScholl> {
+    static const int n = 2;
+
+    WackerScholl() :
+        D(2.0F),
+        alpha(0.02f),
+        tau(0.05f),
+        j0(1.21f),
+        d(8.0f),
+        pal_gs0(new PaletteWS0()),
+        pal_gs1(new PaletteWS1(*this)),
+        pal_gs2(new PaletteWS2(*this))
+    { }
+
+    ~WackerScholl() {
+        delete(pal_gs0);
+        delete(pal_gs1);
+        delete(pal_gs2);
+    }
+
+    vecn get_background_val() {
+        vecn ret;
+        ret[0] = j0/((j0*j0+1)*tau);
+        ret[1] = j0/((j0*j0+1)*tau) + j0;
+        return ret;
+    }
+
+    void get_value_range(vecn &lo, vecn &hi) {
+        vecn bg = get_background_val();
+        lo = bg.array() - 2.0f;
+        hi = bg.array() + 2.0f;
+    }
+
+    vecn get_seed_val(int seed_idx) {
+        //get_background_val(A, B);
+        //switch(seed_idx % 2) {
+        //    case 0:  A += 0.0F; B += 0.1F; break;
+        //    default: A += 0.1F; B += 0.0F; break;
+        //}
+        vecn ret = get_background_val();
+        ret[0] += ((seed_idx*5)%7)/7.0F;
+        ret[1] += ((seed_idx*9)%13)/13.0F;
+        return ret;
+    }
+
+    virtual void set_params(const float *p, int len) {
+        if(len != 5) {
+            LOGE("params is wrong length: %d", len);
+        }
+        D = p[0];
+        alpha = p[1];
+        tau = p[2];
+        j0 = p[3];
+        d = p[4];
+    }
+
+    matnn get_diffusion_matrix() {
+        matnn ret;
+        ret << D, 0, 0, D*d;
+        return ret;
+    }
+
+    float get_diffusion_norm() {
+        return std::max(D, D*d);
+    }
+
+    float get_dt() {
+        return 1.0;
+    }
+
+    void compute_dx_dt(const Row<n> &buf, int w, float dt) {
+        for(int x=0; x<w; x++) {
+            float a = buf.c[0][x];
+            float b = buf.c[1][x];
+
+            buf.c[0][x] += dt * ((b-a)/((b-a)*(b-a)+1) - tau*a);
+            buf.c[1][x] += dt * (alpha*(j0-(b-a)));
+        }
+    }
+
+    struct PaletteWS0 : public Palette<n> {
+        PaletteWS0() {
+            set_feature(0, -200.0f, 0, 0);
+            set_feature(1, 0, 20000.0f, 0);
+            set_feature(2, 0, 0, 1000.0f);
+            set_constant(200.0f, 0, 0);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 3 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            ch.f[0] = bufA.c[0] + x;
+            ch.f[1] = bufL.c[0] + x;
+            ch.f[2] = bufA.c[1] + x;
+        }
+    };
+
+    struct PaletteWS1 : public Palette<n> {
+        PaletteWS1(WackerScholl &x) : parent(x) {
+            set_feature(0, 60000.0f, 0, 0);
+            set_feature(1, 0, 0, 60000.0f);
+        }
+
+        enum { needs_laplacian = 1 };
+        enum { num_features = 2 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            const float *LA = bufL.c[0] + x, *LB = bufL.c[1] + x;
+            float *rv = ch.buf[0], *gv = ch.buf[1];
+            for(int i = 0; i < cnt; i++) {
+                rv[i] = parent.D * LB[i];
+                gv[i] = parent.D * LA[i];
+            }
+            ch.f[0] = rv;
+            ch.f[1] = gv;
+        }
+
+        WackerScholl &parent;
+    };
+
+    struct PaletteWS2 : public Palette<n> {
+        PaletteWS2(WackerScholl &x) : parent(x) {
+            set_feature(0, 0, 255.0f, 0);
+        }
+
+        enum { num_features = 1 };
+
+        void render_chunk(const Row<n> &bufA, const Row<n> &bufL,
+            const Row<n> &bufDX, const Row<n> &bufDY,
+            int x, int cnt, const Eigen::Vector3f &acc, RenderChunk &ch
+        ) {
+            shade_A(bufDX, bufDY, x, cnt, acc, ch);
+            ch.f[0] = ch.dp;
+        }
+
+        WackerScholl &parent;
+    };
+
+    template <typename Op>
+    void with_palette(int id, Op &op) {
+        switch(id) {
+            case 1: op(*pal_gs1); break;
+            case 2: op(*pal_gs2); break;
+            default: op(*pal_gs0); break;
+        }
+    }
+
+    float D, alpha, tau, j0, d;
+    PaletteWS0 *pal_gs0;
+    PaletteWS1 *pal_gs1;
+    PaletteWS2 *pal_gs2;
+};
+
+FunctionBaseBase *fn_list[] = {
+    new GinzburgLandau(),
+    new GrayScott(),
+    new GinzburgLandauQ(),
+    new WackerScholl()
+};
+FunctionBaseBase *fn = fn_list[0];
+int pal_idx = 0;
+// As passed to rdn_set_params, for state files.
+std::vector<float> fn_params;
+// Gravity pointing down the screen until the accelerometer says otherwise.  (This used to
+// be set when there was no grid yet, but the grid belongs to the simulation thread.)
+Eigen::Vector3f last_acc(0, 1, 0);
+
+int rdn_num_functions() {
+    return sizeof(fn_list) / sizeof(fn_list[0]);
+}
+
+int rdn_pixel_size(int format) {
+    switch(format) {
+        case RDN_PIXEL_RGB24:    return 3;
+        case RDN_PIXEL_RGBA8888: return 4;
+        case RDN_PIXEL_RGB565:   return 2;
+        default:                 return 0;
+    }
+}
+
+void rdn_render_frame(uint8_t *pixels, int w, int h, int dir, int format,
+    float acc_x, float acc_y, float acc_z
+) {
+    if(!rdn_pixel_size(format)) {
+        LOGE("bad pixel format: %d", format);
+        return;
+    }
+
+    Eigen::Vector3f acc;
+    acc << acc_x, acc_y, acc_z;
+    acc.normalize();
+
+    if(fabsf(acc[2]) > 0.9) {
+        acc = last_acc;
+    } else {
+        last_acc = acc;
+    }
+
+    acc[2] = 0;
+    acc.normalize();
+    acc[2] = 2;
+    acc.normalize();
+
+    if(dir) acc[0] *= -1;
+
+    //LOGI("acc=%f,%f,%f", acc[0], acc[1], acc[2]);
+
+    fn->draw(w, h, pixels, w*rdn_pixel_size(format), format, pal_idx, dir, acc);
+}
+
+static void reset_steady_state() {
+    steady_skip_interval = 0;
+    steady_skip_left = 0;
+    steady_count = 0;
+}
+
+// Steps back to back until sim_time of model time is covered, or until another step would
+// likely run past max_seconds.  The steady state throttle doesn't apply.  Returns the
+// model time covered.  Must be called with sim_mutex held.
+static float warm_up(float sim_time, float max_seconds) {
+    double t0 = perf_now();
+    double last_step = 0;
+    float covered = 0;
+    while(covered < sim_time) {
+        double t = perf_now();
+        if(t - t0 + last_step > max_seconds) break;
+        if(!fn->step()) break;
+        last_step = perf_now() - t;
+        covered += ITERATIONS_PER_STEP * fn->last_dt;
+    }
+    return covered;
+}
+
+static void evolve() {
+    if(warm_up_pending) {
+        warm_up_pending = false;
+        if(warm_up_time > 0 && warm_up(warm_up_time, warm_up_budget) > 0) {
+            step_count++;
+            reset_steady_state();
+            return;
+        }
+    }
+
+    if(steady_skip_left > 0) {
+        steady_skip_left--;
+        return;
+    }
+
+    fn->step();
+    step_count++;
+
+    float change = fn->last_change;
+    if(change < steady_reset) {
+        if(++steady_count >= STEADY_RESET_STEPS) {
+            LOGI("steady state (change %g), resetting grid", change);
+            fn->reset_grid();
+            reset_steady_state();
+            warm_up_pending = true;
+            return;
+        }
+    } else {
+        steady_count = 0;
+    }
+    if(change < steady_throttle) {
+        steady_skip_interval = std::min(steady_skip_interval*2 + 1, MAX_STEADY_SKIP);
+        steady_skip_left = steady_skip_interval;
+    } else {
+        steady_skip_interval = 0;
+    }
+}
+
+void rdn_evolve() {
+    if(sim_running) return;
+    evolve();
+}
+
+// Wall clock time, which is what pthread_cond_timedwait takes.
+static double realtime_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Where and how often the simulation thread saves the state (see rdn_set_checkpoint).
+std::string checkpoint_path;
+float checkpoint_interval = 0;
+// Held while a state file is written, since writers share the temporary file.
+pthread_mutex_t state_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int fn_index() {
+    return std::find(fn_list, fn_list + rdn_num_functions(), fn) - fn_list;
+}
+
+// Copies what a state file holds out of the current state.  Returns false if there is no
+// state yet.  Must be called with sim_mutex held.
+static bool capture_state(StateFileHeader &hdr, std::vector<float> &data) {
+    if(!grids || fn_params.size() > STATE_FILE_MAX_PARAMS) return false;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.fn_idx = fn_index();
+    hdr.num_params = fn_params.size();
+    std::copy(fn_params.begin(), fn_params.end(), hdr.params);
+    hdr.n = grids->get_n();
+    hdr.w = grids->w;
+    hdr.h = grids->h;
+    data.resize(state_file_data_len(hdr));
+    grids->get_state(&data[0]);
+    return true;
+}
+
+// Writes what capture_state() got.  This is the slow part, so it is done with sim_mutex
+// released.
+static bool write_state(const std::string &path, const StateFileHeader &hdr,
+    const std::vector<float> &data
+) {
+    pthread_mutex_lock(&state_file_mutex);
+    bool ok = write_state_file(path.c_str(), hdr, &data[0]);
+    pthread_mutex_unlock(&state_file_mutex);
+    return ok;
+}
+
+static void *sim_main(void *) {
+    double deadline = realtime_sec();
+    double next_checkpoint = deadline + checkpoint_interval;
+
+    SimLock lock;
+    while(!sim_quit) {
+        unsigned prev_count = step_count;
+        evolve();
+        if(step_count != prev_count) publish_state();
+
+        if(checkpoint_interval > 0 && realtime_sec() >= next_checkpoint) {
+            next_checkpoint = realtime_sec() + checkpoint_interval;
+            StateFileHeader hdr;
+            std::vector<float> data;
+            std::string path = checkpoint_path;
+            if(capture_state(hdr, data)) {
+                pthread_mutex_unlock(&sim_mutex);
+                write_state(path, hdr, data);
+                pthread_mutex_lock(&sim_mutex);
+            }
+        }
+
+        // A step that overran doesn't make the following ones hurry to catch up, and
+        // neither does the clock being set back.
+        double now = realtime_sec();
+        deadline += sim_interval;
+        if(deadline < now || deadline > now + sim_interval) deadline = now;
+
+        if(deadline <= now) {
+            // Give the entry points waiting for the lock a chance.
+            pthread_mutex_unlock(&sim_mutex);
+            sched_yield();
+            pthread_mutex_lock(&sim_mutex);
+            continue;
+        }
+
+        struct timespec ts;
+        ts.tv_sec = (time_t)deadline;
+        ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+        while(!sim_quit && !pthread_cond_timedwait(&sim_cond, &sim_mutex, &ts)) { }
+    }
+    return NULL;
+}
+
+void rdn_start_simulation(float steps_per_second) {
+    SimLock lock;
+    sim_interval = steps_per_second > 0 ? 1.0f / steps_per_second : 0;
+    if(sim_running) return;
+    sim_quit = false;
+    // Picks the kernels before there are two threads to race for it.
+    simd_kernels();
+    if(pthread_create(&sim_thread, NULL, sim_main, NULL)) {
+        LOGE("could not start simulation thread");
+        return;
+    }
+    sim_running = true;
+}
+
+void rdn_stop_simulation() {
+    if(!sim_running) return;
+    {
+        SimLock lock;
+        sim_quit = true;
+        pthread_cond_signal(&sim_cond);
+    }
+    pthread_join(sim_thread, NULL);
+    sim_running = false;
+    last_render_dir = -1;
+
+    // Only needed while the thread runs.
+    for(int i=0; i<3; i++) {
+        delete(snapshots.slot(i));
+        snapshots.slot(i) = NULL;
+    }
+}
+
+void rdn_suspend() {
+    rdn_stop_simulation();
+    StateFileHeader hdr;
+    std::vector<float> data;
+    std::string path;
+    {
+        SimLock lock;
+        if(checkpoint_interval > 0 && capture_state(hdr, data)) path = checkpoint_path;
+        fn->suspend();
+    }
+    if(!path.empty()) write_state(path, hdr, data);
+}
+
+bool rdn_save_state(const char *path) {
+    StateFileHeader hdr;
+    std::vector<float> data;
+    {
+        SimLock lock;
+        if(!capture_state(hdr, data)) return false;
+    }
+    return write_state(path, hdr, data);
+}
+
+bool rdn_load_state(const char *path) {
+    StateFile file;
+    if(!file.open(path)) return false;
+    const StateFileHeader &hdr = file.header();
+
+    SimLock lock;
+    bool same_params = hdr.num_params == (int)fn_params.size() &&
+        std::equal(fn_params.begin(), fn_params.end(), hdr.params);
+    if(hdr.fn_idx != fn_index() || !same_params) {
+        LOGI("%s was saved with other params, not loading it", path);
+        return false;
+    }
+    if(!fn->load_state(hdr.n, hdr.w, hdr.h, file.data())) {
+        LOGE("%s has the wrong number of components", path);
+        return false;
+    }
+    reset_steady_state();
+    if(sim_running) publish_state();
+    return true;
+}
+
+void rdn_set_checkpoint(const char *path, float interval) {
+    SimLock lock;
+    checkpoint_path = path;
+    checkpoint_interval = interval;
+}
+
+float rdn_warm_up(float sim_time, float max_seconds) {
+    SimLock lock;
+    warm_up_pending = false;
+    float covered = warm_up(sim_time, max_seconds);
+    if(covered > 0) {
+        reset_steady_state();
+        if(sim_running) publish_state();
+    }
+    return covered;
+}
+
+void rdn_set_warm_up(float sim_time, float max_seconds) {
+    SimLock lock;
+    warm_up_time = sim_time;
+    warm_up_budget = max_seconds;
+}
+
+unsigned rdn_get_step_count() {
+    return step_count;
+}
+
+void rdn_set_steady_state(float throttle, float reset) {
+    SimLock lock;
+    steady_throttle = throttle;
+    steady_reset = reset;
+    reset_steady_state();
+}
+
+float rdn_get_change_rate() {
+    return fn->last_change;
+}
+
+void rdn_set_sparse_threshold(float eps) {
+    SimLock lock;
+    sparse_threshold = eps;
+}
+
+void rdn_get_activity(int *active, int *total) {
+    SimLock lock;
+    *active = fn->active_tiles;
+    *total = fn->num_tiles;
+}
+
+void rdn_set_params(int fn_idx, const float *params, int len, int _pal_idx) {
+    if(fn_idx < 0 || fn_idx >= rdn_num_functions()) {
+        LOGE("bad function index: %d", fn_idx);
+        return;
+    }
+    SimLock lock;
+    fn = fn_list[fn_idx];
+    pal_idx = _pal_idx;
+    fn_params.assign(params, params + len);
+    fn->set_params(params, len);
+    reset_steady_state();
+}
+
+void rdn_set_color_matrix(const float *cm, int len) {
+    if(len != 20) {
+        LOGE("wrong color matrix len: %d", len);
+        return;
+    }
+    for(int i=0; i<20; i++) {
+        color_matrix[i] = cm[i];
+    }
+    color_matrix_serial++;
+}
+
+void rdn_reset_grid() {
+    SimLock lock;
+    fn->reset_grid();
+    reset_steady_state();
+    warm_up_pending = true;
+}
+
+void rdn_set_num_threads(int num_threads) {
+    SimLock lock;
+    pool.set_num_threads(num_threads);
+}
+
+int rdn_get_num_threads() {
+    return pool.get_num_threads();
+}
+
+void rdn_set_temporal_blocking(bool enable) {
+    SimLock lock;
+    temporal_blocking = enable;
+}
+
+void rdn_set_diffusion_solver(int fn_idx, int solver) {
+    if(fn_idx < 0 || fn_idx >= rdn_num_functions()) {
+        LOGE("bad function index: %d", fn_idx);
+        return;
+    }
+    SimLock lock;
+    fn_list[fn_idx]->diffusion_solver = solver;
+}
+
+void rdn_set_time_tolerance(int fn_idx, float tol) {
+    if(fn_idx < 0 || fn_idx >= rdn_num_functions()) {
+        LOGE("bad function index: %d", fn_idx);
+        return;
+    }
+    SimLock lock;
+    fn_list[fn_idx]->time_tolerance = tol;
+    fn_list[fn_idx]->next_dt = 0;
+}
+
+float rdn_get_time_step() {
+    return fn->last_dt;
+}
+
+void rdn_set_storage_format(int format) {
+    if(format < 0 || format >= RDN_STORAGE_NUM_FORMATS) {
+        LOGE("bad storage format: %d", format);
+        return;
+    }
+    SimLock lock;
+    storage_format = format;
+}
+
+void rdn_set_topology(int _topology) {
+    if(_topology < 0 || _topology >= RDN_TOPOLOGY_NUM_TOPOLOGIES) {
+        LOGE("bad topology: %d", _topology);
+        return;
+    }
+    SimLock lock;
+    topology = _topology;
+}
+
+void rdn_set_laplacian(int stencil) {
+    if(stencil < 0 || stencil >= RDN_LAPLACIAN_NUM_STENCILS) {
+        LOGE("bad laplacian: %d", stencil);
+        return;
+    }
+    SimLock lock;
+    laplacian = stencil;
+}
+
+int rdn_get_state_size(int *w, int *h) {
+    SimLock lock;
+    if(!grids) return 0;
+    *w = grids->w;
+    *h = grids->h;
+    return grids->get_n();
+}
+
+void rdn_get_state(float *dst) {
+    SimLock lock;
+    if(grids) grids->get_state(dst);
+}
+
+void rdn_get_stats(RdnPhaseStats *stats) {
+    pthread_mutex_lock(&stats_mutex);
+    for(int i=0; i<RDN_PHASE_NUM_PHASES; i++) {
+        RdnPhaseStats &s = stats[i];
+        phase_stats[i].summarize(s.mean_ms, s.p95_ms, s.max_ms);
+        s.bytes = phase_stats[i].last_bytes();
+        s.samples = phase_stats[i].count();
+    }
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void rdn_reset_stats() {
+    pthread_mutex_lock(&stats_mutex);
+    for(int i=0; i<RDN_PHASE_NUM_PHASES; i++) phase_stats[i].clear();
+    unreported_render_ms = 0;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void rdn_record_jni_time(float ms) {
+    pthread_mutex_lock(&stats_mutex);
+    phase_stats[RDN_PHASE_JNI].add(std::max(0.0, ms - unreported_render_ms), 0);
+    unreported_render_ms = 0;
+    pthread_mutex_unlock(&stats_mutex);
+}
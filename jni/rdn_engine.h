@@ -0,0 +1,234 @@
+#ifndef RDN_ENGINE_H
+#define RDN_ENGINE_H
+
+#include <stdint.h>
+
+// Platform independent interface to the reaction-diffusion engine.  The JNI entry points in
+// rdnlib.cpp and the host-side tools in host/ are thin wrappers around these.
+
+// Number of entries in the function list (valid values for fn_idx).
+int rdn_num_functions();
+
+void rdn_set_params(int fn_idx, const float *params, int len, int pal_idx);
+
+// 4x5 row-major color matrix, as produced by android.graphics.ColorMatrix.getArray().
+void rdn_set_color_matrix(const float *cm, int len);
+
+void rdn_evolve();
+
+// Runs evolve() on a thread of its own, steps_per_second times a second (or as often as
+// it can if that is 0), so that stepping no longer holds up the caller.  While it runs,
+// rdn_evolve() does nothing and rdn_render_frame() draws the last complete state without
+// waiting for the step in progress.  Other calls that affect the simulation wait for that
+// step to finish.  Calling this again only changes the rate.
+void rdn_start_simulation(float steps_per_second);
+void rdn_stop_simulation();
+
+// Frees what memory can be freed while nothing is drawn: stops the simulation thread and
+// keeps the state in the int16 format (see RdnStorageFormat), or in fp16 if some values lie
+// outside the range int16 covers for the model, without the buffers used for stepping and
+// drawing.  That is about an eighth of what the state takes while the thread runs, as
+// floats with three snapshots.  The next rdn_render_frame() or rdn_evolve(), or the
+// simulation thread once started again, converts the state back, and the pattern carries
+// on where it was.
+void rdn_suspend();
+
+// Checkpoints, so that a restarted process can carry on with the pattern rather than start
+// over from the seeds.  rdn_save_state() writes the state, the model and its params to
+// path (see state_file.h), replacing the file atomically.  Only copying the state out holds
+// up the simulation, and rendering not at all.  rdn_load_state() maps such a file and
+// makes it the state, at the size it was saved with, if the model and params set now are
+// the ones it was saved with.  Otherwise, or if the file is missing or unreadable, it
+// returns false and leaves the state alone.
+bool rdn_save_state(const char *path);
+bool rdn_load_state(const char *path);
+
+// Has the simulation thread save the state to path every interval seconds, and
+// rdn_suspend() save it as well.  An interval of 0, the default, turns this off.
+void rdn_set_checkpoint(const char *path, float interval);
+
+// Fast-forwards the simulation by sim_time units of model time, stepping back to back
+// with all threads and without the steady state throttle, but stops before a step that
+// would likely take it past max_seconds of wall clock time.  A step covers five
+// reaction steps (see rdn_get_time_step).  Returns the model time covered, 0 if there is
+// no grid yet.
+float rdn_warm_up(float sim_time, float max_seconds);
+
+// Has the first evolve() after a new grid is seeded, after rdn_reset_grid() and after a
+// steady state reset do rdn_warm_up(sim_time, max_seconds), so that a developed pattern
+// is shown straight away.  The reset that recovers from a blown up state doesn't count.
+// sim_time 0, the default, turns this off.
+void rdn_set_warm_up(float sim_time, float max_seconds);
+
+// Number of evolve() calls so far that stepped (as opposed to being skipped by the steady
+// state throttle).
+unsigned rdn_get_step_count();
+
+// Output formats of rdn_render_frame.
+enum RdnPixelFormat {
+    // Bytes R, G, B (GL_RGB, GL_UNSIGNED_BYTE).
+    RDN_PIXEL_RGB24,
+    // Bytes R, G, B, 255 (GL_RGBA, GL_UNSIGNED_BYTE).
+    RDN_PIXEL_RGBA8888,
+    // Native endian 16 bit words, red in the top bits (GL_RGB, GL_UNSIGNED_SHORT_5_6_5),
+    // with ordered dithering.
+    RDN_PIXEL_RGB565,
+    RDN_PIXEL_NUM_FORMATS
+};
+
+// Bytes per pixel of a RdnPixelFormat, or 0 if it isn't one.
+int rdn_pixel_size(int format);
+
+// Renders a w*h grid into pixels of the given RdnPixelFormat, rows packed w pixels apart.
+// The grid is (re)allocated if its size doesn't match.  If dir is nonzero the rows are
+// drawn mirrored (for the lower tile).
+void rdn_render_frame(uint8_t *pixels, int w, int h, int dir, int format,
+    float acc_x, float acc_y, float acc_z);
+
+void rdn_reset_grid();
+
+// Steady state detection.  Each evolve() measures how much the state changed: the RMS
+// difference per cell and component, sampled on a subset of rows.  While the change stays
+// below throttle, evolve() backs off and only steps on every 2nd, 4th, ... up to every 16th
+// call.  Once it has stayed below reset for 50 steps the grid is reset.  A threshold of 0
+// disables that action; both are off by default.
+void rdn_set_steady_state(float throttle, float reset);
+
+// The change measured by the last evolve() that stepped.
+float rdn_get_change_rate();
+
+// Sparse stepping.  The grid is divided into tiles of 32x32 cells, and a tile whose cells
+// are all within eps of the model's background state (the blank Gray-Scott medium, say)
+// is quiet.  evolve() skips tiles that are quiet and surrounded by quiet tiles, so sparse
+// patterns cost about in proportion to the area they cover; a skipped tile is stepped
+// again as soon as a neighbour stops being quiet.  Skipped cells are held where they
+// are, off by at most eps from where they would have relaxed to.  This only applies to the
+// plain explicit sweep (not temporal blocking, implicit diffusion or compact storage), to
+// models whose background is a fixed point of the reaction, and to steps of at most 32
+// diffusion substeps.  0, the default, steps every cell.
+void rdn_set_sparse_threshold(float eps);
+
+// Number of tiles the last evolve() that stepped updated, out of the total.
+void rdn_get_activity(int *active, int *total);
+
+// Number of threads used by evolve() and rendering, including the calling thread.
+void rdn_set_num_threads(int num_threads);
+int rdn_get_num_threads();
+
+// Enables or disables temporal blocking of step() (off by default).  Results are identical
+// to the plain sweep.
+void rdn_set_temporal_blocking(bool enable);
+
+// How diffusion is integrated.  The explicit update splits each iteration into as many
+// substeps as stability requires, which grows with the diffusion constant.  The implicit
+// (split backward Euler) solver takes one unconditionally stable step per iteration; it is
+// less accurate, but costs the same for any diffusion constant.  Compact storage formats
+// always use the explicit update.
+enum RdnDiffusionSolver {
+    RDN_DIFFUSION_EXPLICIT,
+    RDN_DIFFUSION_IMPLICIT
+};
+
+// Selects the diffusion solver for one function (explicit by default).
+void rdn_set_diffusion_solver(int fn_idx, int solver);
+
+// Adaptive time stepping for one function.  With tol > 0 each evolve() picks the largest
+// reaction time step (up to 8 times the model's fixed one) whose local error, estimated by
+// step doubling on a sample of rows, is at most tol per cell and component, and splits
+// reaction and diffusion symmetrically (Strang).  0, the default, keeps the fixed step.
+void rdn_set_time_tolerance(int fn_idx, float tol);
+
+// The reaction time step used by the last evolve().
+float rdn_get_time_step();
+
+// How the edges of the grid connect.  The wallpaper tiles the grid with mirrored copies,
+// which a Klein bottle (left and right edges joined, top and bottom joined with a flip)
+// makes seamless.  RDN_TOPOLOGY_NEUMANN has no-flux walls on all four edges.
+enum RdnTopology {
+    RDN_TOPOLOGY_KLEIN,
+    RDN_TOPOLOGY_TORUS,
+    RDN_TOPOLOGY_NEUMANN,
+    RDN_TOPOLOGY_NUM_TOPOLOGIES
+};
+
+// Selects the topology (RDN_TOPOLOGY_KLEIN by default).  Takes effect with the next step.
+void rdn_set_topology(int topology);
+
+// The discrete Laplacian of explicit diffusion.  The 5-point stencil is the cheapest, but
+// its error depends on direction, so patterns on a coarse grid line up with the axes.  The
+// 9-point stencil (neighbours weighted 4, diagonals 1, over 6) has an isotropic leading
+// error term, and a stability bound that allows substeps 1.5 times as long.  The implicit
+// solver always uses the 5-point stencil.
+enum RdnLaplacian {
+    RDN_LAPLACIAN_5_POINT,
+    RDN_LAPLACIAN_9_POINT,
+    RDN_LAPLACIAN_NUM_STENCILS
+};
+
+// Selects the stencil (RDN_LAPLACIAN_5_POINT by default).  Takes effect with the next step.
+void rdn_set_laplacian(int stencil);
+
+// How the simulation state is held in memory.  The 16 bit formats are computed in float
+// but stored compactly; int16 is fixed point over a value range declared by each model.
+// fp16 has a step of 2.4e-4 just below 1, coarser than many per-step changes near a steady
+// value, so the results of each step are rounded stochastically (see storage.h) to keep
+// slow relaxations moving.  The state thus picks up a little noise: a growing pattern
+// drifts from the float one sooner, but settles where the float one would.
+enum RdnStorageFormat {
+    RDN_STORAGE_FLOAT,
+    RDN_STORAGE_FP16,
+    RDN_STORAGE_INT16,
+    RDN_STORAGE_NUM_FORMATS
+};
+
+// Selects the storage format (RDN_STORAGE_FLOAT by default).  The current state is
+// converted when the grid is next used.
+void rdn_set_storage_format(int format);
+
+// Phases timed for rdn_get_stats().  Each step and each rdn_render_frame() call adds one
+// sample to the phases it goes through.
+enum RdnPhase {
+    // A whole evolve() step.
+    RDN_PHASE_STEP,
+    // The parts of the step spent on diffusion (the Laplacian stencil and the update are
+    // one pass, or the implicit solves) and on reaction.  With temporal blocking these are
+    // interleaved tile by tile.  Measured on the first thread, including waits for the
+    // others.
+    RDN_PHASE_DIFFUSION,
+    RDN_PHASE_REACTION,
+    // A whole rdn_render_frame().
+    RDN_PHASE_RENDER,
+    // The part of rendering spent on the gradient and Laplacian, averaged over threads.
+    RDN_PHASE_GRADIENT,
+    // The part of a JNI renderFrame call outside rdn_render_frame (see
+    // rdn_record_jni_time).
+    RDN_PHASE_JNI,
+    RDN_PHASE_NUM_PHASES
+};
+
+struct RdnPhaseStats {
+    // Over the last 128 samples.
+    float mean_ms, p95_ms, max_ms;
+    // Estimated memory traffic of the last sample: state and pixels read and written by
+    // passes over the whole grid.  Rows reused from cache within a pass (such as the tiles
+    // of temporal blocking) aren't counted.  A temporally blocked pass serves diffusion and
+    // reaction at once, and is split between them by their number of ops.
+    float bytes;
+    int samples;
+};
+
+// Fills stats[0..RDN_PHASE_NUM_PHASES).
+void rdn_get_stats(RdnPhaseStats *stats);
+void rdn_reset_stats();
+
+// Reports how long the caller's JNI renderFrame calls took since the last report.  The
+// part not spent in rdn_render_frame is added to RDN_PHASE_JNI.
+void rdn_record_jni_time(float ms);
+
+// Size of the current grid and its number of components; returns 0 if there is no grid yet.
+int rdn_get_state_size(int *w, int *h);
+
+// Copies the state out, one w*h plane per component.
+void rdn_get_state(float *dst);
+
+#endif // RDN_ENGINE_H
@@ -0,0 +1,16 @@
+#ifndef RDN_LOG_H
+#define RDN_LOG_H
+
+#define LOG_TAG "rdn"
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#define LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#define LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#include <stdio.h>
+#define LOGI(...)  do { fprintf(stderr, LOG_TAG ": " __VA_ARGS__); fputc('\n', stderr); } while(0)
+#define LOGE(...)  do { fprintf(stderr, LOG_TAG " error: " __VA_ARGS__); fputc('\n', stderr); } while(0)
+#endif
+
+#endif // RDN_LOG_H
@@ -0,0 +1,144 @@
+#include "simd.h"
+#include "simd_kernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(RDN_HAVE_NEON) && defined(__ANDROID__)
+#include <cpu-features.h>
+#endif
+
+#if defined(__SSE2__)
+// Internal, see simd_kernels.h.
+namespace {
+
+struct VecSSE2 {
+    typedef __m128 type;
+    enum { width = 4 };
+    static inline type load(const float *p) { return _mm_loadu_ps(p); }
+    static inline void store(float *p, type v) { _mm_storeu_ps(p, v); }
+    static inline type set1(float v) { return _mm_set1_ps(v); }
+    static inline type add(type a, type b) { return _mm_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm_mul_ps(a, b); }
+    static inline type min(type a, type b) { return _mm_min_ps(a, b); }
+    static inline type max(type a, type b) { return _mm_max_ps(a, b); }
+    static inline type rsqrt(type a) {
+        // One Newton step on the 12 bit estimate.
+        type y = _mm_rsqrt_ps(a);
+        type ay2 = _mm_mul_ps(_mm_mul_ps(a, y), y);
+        return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), ay2));
+    }
+    static inline type mask_ge(type a, type b, type v) {
+        return _mm_and_ps(_mm_cmpge_ps(a, b), v);
+    }
+    static inline void store_int(int *p, type v) {
+        _mm_storeu_si128((__m128i *)p, _mm_cvttps_epi32(v));
+    }
+};
+
+} // namespace
+#endif
+
+// Defined in simd_avx2.cpp and simd_neon.cpp, which are built with extra compiler flags.
+#ifdef RDN_HAVE_AVX2
+extern const SimdKernels simd_kernels_avx2;
+#endif
+#ifdef RDN_HAVE_NEON
+extern const SimdKernels simd_kernels_neon;
+#endif
+
+static const SimdKernels kernels_scalar = SIMD_KERNELS_TABLE(VecScalar, SIMD_SCALAR);
+#if defined(__SSE2__)
+static const SimdKernels kernels_sse2 = SIMD_KERNELS_TABLE(VecSSE2, SIMD_SSE2);
+#endif
+
+static const SimdKernels *get_table(SimdLevel level) {
+    switch(level) {
+        case SIMD_SCALAR:
+            return &kernels_scalar;
+#if defined(__SSE2__)
+        case SIMD_SSE2:
+            return &kernels_sse2;
+#endif
+#ifdef RDN_HAVE_AVX2
+        case SIMD_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? &simd_kernels_avx2 : 0;
+#endif
+#ifdef RDN_HAVE_NEON
+        case SIMD_NEON:
+#ifdef __ANDROID__
+            if(android_getCpuFamily() != ANDROID_CPU_FAMILY_ARM) return 0;
+            return (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) ?
+                &simd_kernels_neon : 0;
+#else
+            return &simd_kernels_neon;
+#endif
+#endif
+        default:
+            return 0;
+    }
+}
+
+static const SimdKernels *detect() {
+    static const SimdLevel preference[] = { SIMD_AVX2, SIMD_NEON, SIMD_SSE2 };
+    for(unsigned i=0; i<sizeof(preference)/sizeof(preference[0]); i++) {
+        const SimdKernels *k = get_table(preference[i]);
+        if(k) return k;
+    }
+    return &kernels_scalar;
+}
+
+static const SimdKernels *current = 0;
+
+const SimdKernels &simd_kernels() {
+    if(!current) current = detect();
+    return *current;
+}
+
+bool simd_set_level(SimdLevel level) {
+    const SimdKernels *k = get_table(level);
+    if(!k) return false;
+    current = k;
+    return true;
+}
+
+const char *simd_level_name(SimdLevel level) {
+    switch(level) {
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE2:   return "sse2";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_NEON:   return "neon";
+        default:          return "?";
+    }
+}
+
+#if defined(__SSE2__)
+FlushToZero::FlushToZero() {
+    saved = _mm_getcsr();
+    // FTZ (bit 15) and DAZ (bit 6)
+    _mm_setcsr(saved | 0x8040);
+}
+
+FlushToZero::~FlushToZero() {
+    _mm_setcsr(saved);
+}
+#elif defined(__arm__) && !defined(__SOFTFP__)
+// NEON always flushes denormals; this sets the FZ bit so that VFP scalar code does too.
+FlushToZero::FlushToZero() {
+    unsigned fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    saved = fpscr;
+    fpscr |= 1 << 24;
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+}
+
+FlushToZero::~FlushToZero() {
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(saved));
+}
+#else
+FlushToZero::FlushToZero() : saved(0) { }
+FlushToZero::~FlushToZero() { }
+#endif
@@ -0,0 +1,64 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "rdn_engine.h"
+
+// Runtime selection of the vectorized kernels in simd_kernels.h.  The best instruction set
+// supported by the CPU is picked the first time simd_kernels() is called.
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON,
+    SIMD_NUM_LEVELS
+};
+
+// See diffuse_row_kernel().
+typedef void (*DiffuseRowFn)(const float *M, float *const *O, const float *const *C,
+    const float *const *U, const float *const *D, int w);
+
+// See emit_kernel().  Q is the 3x5 row-major color transform: the first MAX_FEATURES
+// columns weigh the feature rows f, the last is a constant.
+#define MAX_FEATURES 4
+#define EMIT_BLOCK 64
+typedef void (*EmitFn)(const float *const *f, const float *Q, void *dst, int w,
+    int pix_step, int x, int y);
+
+struct SimdKernels {
+    SimdLevel level;
+    // Indexed by the number of components, 1 to 4.
+    DiffuseRowFn diffuse_row[5];
+    // The same with the 9-point Laplacian, see diffuse_row_9_kernel().
+    DiffuseRowFn diffuse_row_9[5];
+    void (*react_gray_scott)(float *A, float *B, int w, float dt, float F, float k);
+    void (*react_ginzburg_landau)(float *U, float *V, int w, float dt, float beta);
+    void (*react_ginzburg_landau_q)(float *const *Q, int w, float dt, float beta,
+        const float *F);
+    void (*shade)(const float *sx, const float *sy, float *dp, float *spec, int w,
+        float ax, float ay, float az);
+    // Indexed by RdnPixelFormat and the number of features, 0 to MAX_FEATURES.
+    EmitFn emit[RDN_PIXEL_NUM_FORMATS][MAX_FEATURES+1];
+};
+
+const SimdKernels &simd_kernels();
+
+// Overrides the automatic choice, e.g. for benchmarking.  Returns false if the level isn't
+// compiled in or the CPU doesn't support it.
+bool simd_set_level(SimdLevel level);
+
+const char *simd_level_name(SimdLevel level);
+
+// Sets flush-to-zero (and denormals-are-zero where available) for the current thread, and
+// restores the previous mode when it goes out of scope.  Gray-Scott in particular decays
+// toward zero and spends much of its time on denormal operands otherwise.
+class FlushToZero {
+public:
+    FlushToZero();
+    ~FlushToZero();
+
+private:
+    unsigned saved;
+};
+
+#endif // SIMD_H
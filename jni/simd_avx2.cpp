@@ -0,0 +1,43 @@
+// AVX2 instantiations of the kernels.  Built with -mavx2 and only used if the CPU reports
+// AVX2 support (see simd.cpp), so nothing else may be included here; see simd_kernels.h.
+
+#ifdef RDN_HAVE_AVX2
+
+#include <immintrin.h>
+
+#include "simd.h"
+#include "simd_kernels.h"
+
+// Internal, see simd_kernels.h.
+namespace {
+
+struct VecAVX2 {
+    typedef __m256 type;
+    enum { width = 8 };
+    static inline type load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+    static inline type set1(float v) { return _mm256_set1_ps(v); }
+    static inline type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static inline type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static inline type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static inline type min(type a, type b) { return _mm256_min_ps(a, b); }
+    static inline type max(type a, type b) { return _mm256_max_ps(a, b); }
+    static inline type rsqrt(type a) {
+        type y = _mm256_rsqrt_ps(a);
+        type ay2 = _mm256_mul_ps(_mm256_mul_ps(a, y), y);
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), y),
+            _mm256_sub_ps(_mm256_set1_ps(3.0f), ay2));
+    }
+    static inline type mask_ge(type a, type b, type v) {
+        return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ), v);
+    }
+    static inline void store_int(int *p, type v) {
+        _mm256_storeu_si256((__m256i *)p, _mm256_cvttps_epi32(v));
+    }
+};
+
+} // namespace
+
+extern const SimdKernels simd_kernels_avx2 = SIMD_KERNELS_TABLE(VecAVX2, SIMD_AVX2);
+
+#endif
@@ -0,0 +1,427 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+// Vectorized inner loops, written once against a small vector interface and instantiated
+// for each instruction set (see simd.cpp, simd_avx2.cpp, simd_neon.cpp).  Each vector type
+// provides:
+//
+//     typedef ... type;  enum { width = ... };
+//     load, store, set1, add, sub, mul, min, max
+//     rsqrt(a)            1/sqrt(a), possibly approximate (about 22 bits)
+//     mask_ge(a, b, v)    v where a >= b, else 0
+//     store_int(p, v)     stores v truncated to int
+//
+// Every simulation kernel performs the same float operations in the same order as the
+// scalar code in rdn_engine.cpp, so all instruction sets give bit-identical results.  The
+// render kernels use rsqrt and only agree to within rounding, which is fine for pixels that
+// are never fed back into the simulation.  The horizontal
+// neighbours of the Laplacian are summed as a pair, (left + right), so that a mirrored copy
+// of a row (as in the Klein bottle halos of temporal blocking) evolves as the exact mirror.
+//
+// This header deliberately includes nothing.  The AVX2 instantiations are compiled with
+// -mavx2, and any inline function pulled in from a shared header would be emitted there
+// with AVX2 code and might be picked by the linker for use everywhere.  For the same
+// reason everything here is in an anonymous namespace, and the vector types defined next
+// to each instantiation must be too: inline members and template instances otherwise have
+// external linkage, so an unoptimized build emits them as weak symbols in every file and
+// keeps only one copy, perhaps the AVX2 or NEON one.
+
+namespace {
+
+struct VecScalar {
+    typedef float type;
+    enum { width = 1 };
+    static inline type load(const float *p) { return *p; }
+    static inline void store(float *p, type v) { *p = v; }
+    static inline type set1(float v) { return v; }
+    static inline type add(type a, type b) { return a + b; }
+    static inline type sub(type a, type b) { return a - b; }
+    static inline type mul(type a, type b) { return a * b; }
+    // Written so that a NaN in a gives b, like the vector versions with b as the bound.
+    static inline type min(type a, type b) { return a < b ? a : b; }
+    static inline type max(type a, type b) { return a > b ? a : b; }
+    static inline type rsqrt(type a) { return 1.0f / __builtin_sqrtf(a); }
+    static inline type mask_ge(type a, type b, type v) { return a >= b ? v : 0.0f; }
+    static inline void store_int(int *p, type v) { *p = (int)v; }
+};
+
+// One output pixel of the diffusion update, for the tail of a row.
+template <int n>
+static inline void diffuse_pixel(const float *M, float *const *O, const float *const *C,
+    const float *const *U, const float *const *D, int x
+) {
+    float l[n];
+    for(int j=0; j<n; j++) {
+        l[j] = -4.0f * C[j][x] + (U[j][x] + D[j][x]) + (C[j][x-1] + C[j][x+1]);
+    }
+    for(int i=0; i<n; i++) {
+        float acc = 0;
+        for(int j=0; j<n; j++) acc += M[i*n+j] * l[j];
+        O[i][x] = C[i][x] + acc;
+    }
+}
+
+// O = C + M * laplacian, for a row whose vertical neighbours are U and D.  C holds the
+// old values of the row (it must not alias O), with its ghost columns C[j][-1] and C[j][w]
+// filled in, so the whole row is one straight vector loop.  M is n*n row-major.
+template <class V, int n>
+void diffuse_row_kernel(const float *M, float *const *O, const float *const *C,
+    const float *const *U, const float *const *D, int w
+) {
+    typedef typename V::type vt;
+
+    vt m[n*n];
+    for(int i=0; i<n*n; i++) m[i] = V::set1(M[i]);
+    vt m4 = V::set1(-4.0f);
+
+    int x = 0;
+    for(; x + V::width <= w; x += V::width) {
+        vt l[n];
+        for(int j=0; j<n; j++) {
+            const float *c = C[j] + x;
+            vt t = V::mul(m4, V::load(c));
+            t = V::add(t, V::add(V::load(U[j] + x), V::load(D[j] + x)));
+            l[j] = V::add(t, V::add(V::load(c - 1), V::load(c + 1)));
+        }
+        for(int i=0; i<n; i++) {
+            vt acc = V::mul(m[i*n], l[0]);
+            for(int j=1; j<n; j++) acc = V::add(acc, V::mul(m[i*n+j], l[j]));
+            V::store(O[i] + x, V::add(V::load(C[i] + x), acc));
+        }
+    }
+    for(; x < w; x++) {
+        diffuse_pixel<n>(M, O, C, U, D, x);
+    }
+}
+
+// One output pixel of the 9-point diffusion update, for the tail of a row.
+template <int n>
+static inline void diffuse_pixel_9(const float *M, float *const *O, const float *const *C,
+    const float *const *U, const float *const *D, int x
+) {
+    float l[n];
+    for(int j=0; j<n; j++) {
+        float t = -20.0f * C[j][x];
+        t += 4.0f * ((U[j][x] + D[j][x]) + (C[j][x-1] + C[j][x+1]));
+        t += (U[j][x-1] + U[j][x+1]) + (D[j][x-1] + D[j][x+1]);
+        l[j] = (1.0f / 6.0f) * t;
+    }
+    for(int i=0; i<n; i++) {
+        float acc = 0;
+        for(int j=0; j<n; j++) acc += M[i*n+j] * l[j];
+        O[i][x] = C[i][x] + acc;
+    }
+}
+
+// Like diffuse_row_kernel, with the isotropic 9-point Laplacian
+//
+//     (4 (up + down + left + right) + (the four diagonals) - 20 center) / 6
+//
+// which also reads the ghost columns of U and D.  The pairs are summed symmetrically, as
+// above, so mirrored rows still evolve as exact mirrors.
+template <class V, int n>
+void diffuse_row_9_kernel(const float *M, float *const *O, const float *const *C,
+    const float *const *U, const float *const *D, int w
+) {
+    typedef typename V::type vt;
+
+    vt m[n*n];
+    for(int i=0; i<n*n; i++) m[i] = V::set1(M[i]);
+    vt m20 = V::set1(-20.0f);
+    vt m4 = V::set1(4.0f);
+    vt sixth = V::set1(1.0f / 6.0f);
+
+    int x = 0;
+    for(; x + V::width <= w; x += V::width) {
+        vt l[n];
+        for(int j=0; j<n; j++) {
+            const float *c = C[j] + x;
+            const float *u = U[j] + x;
+            const float *d = D[j] + x;
+            vt t = V::mul(m20, V::load(c));
+            vt e = V::add(V::add(V::load(u), V::load(d)),
+                V::add(V::load(c - 1), V::load(c + 1)));
+            t = V::add(t, V::mul(m4, e));
+            vt k = V::add(V::add(V::load(u - 1), V::load(u + 1)),
+                V::add(V::load(d - 1), V::load(d + 1)));
+            l[j] = V::mul(sixth, V::add(t, k));
+        }
+        for(int i=0; i<n; i++) {
+            vt acc = V::mul(m[i*n], l[0]);
+            for(int j=1; j<n; j++) acc = V::add(acc, V::mul(m[i*n+j], l[j]));
+            V::store(O[i] + x, V::add(V::load(C[i] + x), acc));
+        }
+    }
+    for(; x < w; x++) {
+        diffuse_pixel_9<n>(M, O, C, U, D, x);
+    }
+}
+
+template <class V>
+void react_gray_scott_kernel(float *A, float *B, int w, float dt, float F, float k) {
+    typedef typename V::type vt;
+    vt vdt = V::set1(dt);
+    vt vF = V::set1(F);
+    vt vFk = V::set1(F+k);
+    vt one = V::set1(1.0f);
+    vt zero = V::set1(0.0f);
+    int x = 0;
+    for(; x + V::width <= w; x += V::width) {
+        vt a = V::load(A + x);
+        vt b = V::load(B + x);
+        vt abb = V::mul(V::mul(a, b), b);
+        // -a*b*b is evaluated as (-a*b)*b in the scalar code
+        vt da = V::add(V::mul(V::mul(V::sub(zero, a), b), b), V::mul(vF, V::sub(one, a)));
+        vt db = V::sub(abb, V::mul(vFk, b));
+        V::store(A + x, V::add(a, V::mul(vdt, da)));
+        V::store(B + x, V::add(b, V::mul(vdt, db)));
+    }
+    for(; x < w; x++) {
+        float a = A[x];
+        float b = B[x];
+        A[x] += dt * (-a*b*b + F*(1.0f-a));
+        B[x] += dt * ( a*b*b - (F+k)*b);
+    }
+}
+
+template <class V>
+void react_ginzburg_landau_kernel(float *Ub, float *Vb, int w, float dt, float beta) {
+    typedef typename V::type vt;
+    vt vdt = V::set1(dt);
+    vt vdtb = V::set1(dt*beta);
+    vt one = V::set1(1.0f);
+    vt half = V::set1(0.5f);
+    int x = 0;
+    for(; x + V::width <= w; x += V::width) {
+        vt u = V::load(Ub + x);
+        vt v = V::load(Vb + x);
+        vt r2 = V::add(V::mul(u, u), V::mul(v, v));
+        vt s = V::sub(one, r2);
+        u = V::add(u, V::mul(V::mul(vdt, u), s));
+        v = V::add(v, V::mul(V::mul(vdt, v), s));
+        vt t = V::mul(vdtb, r2);
+        vt c = V::sub(one, V::mul(V::mul(t, t), half));
+        V::store(Ub + x, V::sub(V::mul(u, c), V::mul(v, t)));
+        V::store(Vb + x, V::add(V::mul(v, c), V::mul(u, t)));
+    }
+    for(; x < w; x++) {
+        float u = Ub[x];
+        float v = Vb[x];
+        float r2 = u*u + v*v;
+        u += dt * u*(1.0f-r2);
+        v += dt * v*(1.0f-r2);
+        float t = dt*beta*r2;
+        Ub[x] = u*(1.0f-t*t/2.0f) - v*t;
+        Vb[x] = v*(1.0f-t*t/2.0f) + u*t;
+    }
+}
+
+// The quaternion Ginzburg-Landau reaction on the four component planes Q, with F the 4x4
+// row-major coupling matrix.  Each vector holds one component of V::width pixels, so the
+// matrix product is 16 multiply-adds per vector of pixels.
+template <class V>
+void react_ginzburg_landau_q_kernel(float *const *Q, int w, float dt, float beta,
+    const float *F
+) {
+    typedef typename V::type vt;
+    vt vdt = V::set1(dt);
+    vt vdtb = V::set1(dt*beta);
+    vt one = V::set1(1.0f);
+    vt half = V::set1(0.5f);
+    vt f[16];
+    for(int i=0; i<16; i++) f[i] = V::set1(F[i]);
+    int x = 0;
+    for(; x + V::width <= w; x += V::width) {
+        vt q[4];
+        for(int i=0; i<4; i++) q[i] = V::load(Q[i] + x);
+        vt r2 = V::mul(q[0], q[0]);
+        for(int i=1; i<4; i++) r2 = V::add(r2, V::mul(q[i], q[i]));
+        vt s = V::sub(one, r2);
+        for(int i=0; i<4; i++) q[i] = V::add(q[i], V::mul(V::mul(vdt, q[i]), s));
+        vt t = V::mul(vdtb, r2);
+        vt c = V::sub(one, V::mul(V::mul(t, t), half));
+        for(int i=0; i<4; i++) {
+            vt fq = V::mul(f[i*4], q[0]);
+            for(int j=1; j<4; j++) fq = V::add(fq, V::mul(f[i*4+j], q[j]));
+            V::store(Q[i] + x, V::sub(V::mul(q[i], c), V::mul(fq, t)));
+        }
+    }
+    for(; x < w; x++) {
+        float q[4];
+        for(int i=0; i<4; i++) q[i] = Q[i][x];
+        float r2 = q[0]*q[0];
+        for(int i=1; i<4; i++) r2 += q[i]*q[i];
+        for(int i=0; i<4; i++) q[i] += dt * q[i]*(1.0f-r2);
+        float t = dt*beta*r2;
+        for(int i=0; i<4; i++) {
+            float fq = F[i*4]*q[0];
+            for(int j=1; j<4; j++) fq += F[i*4+j]*q[j];
+            Q[i][x] = q[i]*(1.0f-t*t/2.0f) - fq*t;
+        }
+    }
+}
+
+// Lambert term dp = max(0, normalize(sx, sy, 1) . (ax, ay, az)) of a height field with
+// slopes sx, sy, and the specular highlight spec = dp^64 (zero below dp = 0.94).  Processes
+// [x, w) in whole vectors and returns where it stopped.
+template <class V>
+static inline int shade_span(const float *sx, const float *sy, float *dp, float *spec,
+    int x, int w, float ax, float ay, float az
+) {
+    typedef typename V::type vt;
+    vt vax = V::set1(ax);
+    vt vay = V::set1(ay);
+    vt vaz = V::set1(az);
+    vt one = V::set1(1.0f);
+    vt zero = V::set1(0.0f);
+    vt cutoff = V::set1(0.94f);
+    for(; x + V::width <= w; x += V::width) {
+        vt a = V::load(sx + x);
+        vt b = V::load(sy + x);
+        vt len2 = V::add(V::add(V::mul(a, a), V::mul(b, b)), one);
+        vt d = V::add(V::add(V::mul(a, vax), V::mul(b, vay)), vaz);
+        d = V::max(V::mul(d, V::rsqrt(len2)), zero);
+        V::store(dp + x, d);
+        vt s = V::mul(d, d);
+        s = V::mul(s, s);
+        s = V::mul(s, s);
+        s = V::mul(s, s);
+        s = V::mul(s, s);
+        s = V::mul(s, s);
+        V::store(spec + x, V::mask_ge(d, cutoff, s));
+    }
+    return x;
+}
+
+template <class V>
+void shade_kernel(const float *sx, const float *sy, float *dp, float *spec, int w,
+    float ax, float ay, float az
+) {
+    int x = shade_span<V>(sx, sy, dp, spec, 0, w, ax, ay, az);
+    shade_span<VecScalar>(sx, sy, dp, spec, x, w, ax, ay, az);
+}
+
+// 4x4 ordered dither matrix for RGB565.
+static const unsigned char bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+// Color of one block of pixels from K feature rows f[k]: channel c is
+// Q[c*5+4] + sum_k Q[c*5+k] * f[k][x], on a 0-255 scale.  It is converted to 0..top[c] by
+// scale[c] and, if dithering, offset by dither[x & 3] before being clamped and truncated.
+template <class V, int K, bool dither>
+static inline int emit_span(const float *const *f, const float *Q, int (*out)[EMIT_BLOCK],
+    int x0, int x, int cnt, const float *scale, const float *top, const float *dither_row
+) {
+    typedef typename V::type vt;
+    vt q[3][K+1];
+    vt vscale[3];
+    vt vtop[3];
+    for(int c=0; c<3; c++) {
+        for(int k=0; k<K; k++) q[c][k] = V::set1(Q[c*5+k]);
+        q[c][K] = V::set1(Q[c*5+4]);
+        vscale[c] = V::set1(scale[c]);
+        vtop[c] = V::set1(top[c]);
+    }
+    vt zero = V::set1(0.0f);
+    for(; x + V::width <= cnt; x += V::width) {
+        vt fv[K > 0 ? K : 1];
+        for(int k=0; k<K; k++) fv[k] = V::load(f[k] + x0 + x);
+        // Blocks and vectors start on multiples of 4, so this is the right phase.
+        vt t = dither ? V::load(dither_row + ((x0 + x) & 3)) : zero;
+        for(int c=0; c<3; c++) {
+            vt acc = q[c][K];
+            for(int k=0; k<K; k++) acc = V::add(acc, V::mul(q[c][k], fv[k]));
+            if(dither) acc = V::add(V::mul(acc, vscale[c]), t);
+            V::store_int(out[c] + x, V::min(V::max(acc, zero), vtop[c]));
+        }
+    }
+    return x;
+}
+
+// Writes w pixels in the given RdnPixelFormat, starting at dst and pix_step (+-1) pixels
+// apart.  (x, y) is the grid position of the first pixel, for the dither pattern.
+template <class V, int K, int format>
+void emit_kernel(const float *const *f, const float *Q, void *dst, int w, int pix_step,
+    int x, int y
+) {
+    const bool dither = format == RDN_PIXEL_RGB565;
+    static const float scale565[3] = { 31.0f/255.0f, 63.0f/255.0f, 31.0f/255.0f };
+    static const float top565[3] = { 31.0f, 63.0f, 31.0f };
+    static const float scale888[3] = { 1.0f, 1.0f, 1.0f };
+    static const float top888[3] = { 255.0f, 255.0f, 255.0f };
+    const float *scale = dither ? scale565 : scale888;
+    const float *top = dither ? top565 : top888;
+    // Thresholds for pixels x, x+1, ..., with room for a full AVX vector from any phase.
+    float dither_row[12];
+    for(int i=0; i<12; i++) dither_row[i] = (bayer4[y & 3][(x + i) & 3] + 0.5f) / 16.0f;
+
+    int out[3][EMIT_BLOCK];
+    for(int x0 = 0; x0 < w; x0 += EMIT_BLOCK) {
+        int cnt = w - x0 < EMIT_BLOCK ? w - x0 : EMIT_BLOCK;
+        int i = emit_span<V, K, dither>(f, Q, out, x0, 0, cnt, scale, top, dither_row);
+        emit_span<VecScalar, K, dither>(f, Q, out, x0, i, cnt, scale, top, dither_row);
+        const int *r = out[0], *g = out[1], *b = out[2];
+        // Separate loops for each direction so that the compiler can vectorize them.
+        if(format == RDN_PIXEL_RGB24) {
+            unsigned char *d = (unsigned char *)dst + 3*x0*pix_step;
+            for(i = 0; i < cnt; i++) {
+                d[0] = (unsigned char)r[i];
+                d[1] = (unsigned char)g[i];
+                d[2] = (unsigned char)b[i];
+                d += 3*pix_step;
+            }
+        } else if(format == RDN_PIXEL_RGBA8888) {
+            // Bytes R, G, B, A in memory, on a little endian CPU.
+            unsigned int *d = (unsigned int *)dst + x0*pix_step;
+            if(pix_step > 0) {
+                for(i = 0; i < cnt; i++) d[i] = 0xff000000u | (b[i] << 16) | (g[i] << 8) | r[i];
+            } else {
+                for(i = 0; i < cnt; i++) d[-i] = 0xff000000u | (b[i] << 16) | (g[i] << 8) | r[i];
+            }
+        } else {
+            unsigned short *d = (unsigned short *)dst + x0*pix_step;
+            if(pix_step > 0) {
+                for(i = 0; i < cnt; i++) d[i] = (unsigned short)((r[i] << 11) | (g[i] << 5) | b[i]);
+            } else {
+                for(i = 0; i < cnt; i++) d[-i] = (unsigned short)((r[i] << 11) | (g[i] << 5) | b[i]);
+            }
+        }
+    }
+}
+
+} // namespace
+
+#define SIMD_EMIT_ROW(V, format) { \
+    emit_kernel<V, 0, format>, \
+    emit_kernel<V, 1, format>, \
+    emit_kernel<V, 2, format>, \
+    emit_kernel<V, 3, format>, \
+    emit_kernel<V, 4, format> }
+
+// Fills in a SimdKernels table with the instantiations for vector type V.
+#define SIMD_KERNELS_TABLE(V, level_) { \
+    level_, \
+    { 0, \
+      diffuse_row_kernel<V, 1>, \
+      diffuse_row_kernel<V, 2>, \
+      diffuse_row_kernel<V, 3>, \
+      diffuse_row_kernel<V, 4> }, \
+    { 0, \
+      diffuse_row_9_kernel<V, 1>, \
+      diffuse_row_9_kernel<V, 2>, \
+      diffuse_row_9_kernel<V, 3>, \
+      diffuse_row_9_kernel<V, 4> }, \
+    react_gray_scott_kernel<V>, \
+    react_ginzburg_landau_kernel<V>, \
+    react_ginzburg_landau_q_kernel<V>, \
+    shade_kernel<V>, \
+    { SIMD_EMIT_ROW(V, RDN_PIXEL_RGB24), \
+      SIMD_EMIT_ROW(V, RDN_PIXEL_RGBA8888), \
+      SIMD_EMIT_ROW(V, RDN_PIXEL_RGB565) } \
+}
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,42 @@
+// NEON instantiations of the kernels, for armeabi-v7a.  Built with -mfpu=neon and only used
+// if the CPU reports NEON support (see simd.cpp).
+
+#ifdef RDN_HAVE_NEON
+
+#include <arm_neon.h>
+
+#include "simd.h"
+#include "simd_kernels.h"
+
+// Internal, see simd_kernels.h.
+namespace {
+
+struct VecNEON {
+    typedef float32x4_t type;
+    enum { width = 4 };
+    static inline type load(const float *p) { return vld1q_f32(p); }
+    static inline void store(float *p, type v) { vst1q_f32(p, v); }
+    static inline type set1(float v) { return vdupq_n_f32(v); }
+    static inline type add(type a, type b) { return vaddq_f32(a, b); }
+    static inline type sub(type a, type b) { return vsubq_f32(a, b); }
+    // vmulq rather than vmlaq: keeps rounding identical to the scalar code.
+    static inline type mul(type a, type b) { return vmulq_f32(a, b); }
+    static inline type min(type a, type b) { return vminq_f32(a, b); }
+    static inline type max(type a, type b) { return vmaxq_f32(a, b); }
+    static inline type rsqrt(type a) {
+        // The estimate is only good to 8 bits; two Newton steps.
+        type y = vrsqrteq_f32(a);
+        y = vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+        return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+    }
+    static inline type mask_ge(type a, type b, type v) {
+        return vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(a, b), vreinterpretq_u32_f32(v)));
+    }
+    static inline void store_int(int *p, type v) { vst1q_s32(p, vcvtq_s32_f32(v)); }
+};
+
+} // namespace
+
+extern const SimdKernels simd_kernels_neon = SIMD_KERNELS_TABLE(VecNEON, SIMD_NEON);
+
+#endif
@@ -0,0 +1,102 @@
+#include "state_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "rdn_log.h"
+
+static bool write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while(len > 0) {
+        ssize_t r = write(fd, p, len);
+        if(r < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        p += r;
+        len -= r;
+    }
+    return true;
+}
+
+bool write_state_file(const char *path, StateFileHeader hdr, const float *data) {
+    hdr.magic = STATE_FILE_MAGIC;
+    hdr.version = STATE_FILE_VERSION;
+
+    std::string tmp = std::string(path) + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0) {
+        LOGE("could not create %s: %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = write_all(fd, &hdr, sizeof(hdr)) &&
+        write_all(fd, data, state_file_data_len(hdr) * sizeof(float)) &&
+        fsync(fd) == 0;
+    if(!ok) LOGE("could not write %s: %s", tmp.c_str(), strerror(errno));
+    if(::close(fd) != 0) ok = false;
+    if(ok && rename(tmp.c_str(), path) != 0) {
+        LOGE("could not rename %s: %s", tmp.c_str(), strerror(errno));
+        ok = false;
+    }
+    if(!ok) unlink(tmp.c_str());
+    return ok;
+}
+
+StateFile::StateFile() :
+    map(NULL),
+    size(0)
+{ }
+
+StateFile::~StateFile() {
+    close();
+}
+
+void StateFile::close() {
+    if(map) munmap(map, size);
+    map = NULL;
+    size = 0;
+}
+
+bool StateFile::open(const char *path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if(fd < 0) {
+        if(errno != ENOENT) LOGE("could not open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(StateFileHeader)) {
+        LOGE("%s is too short for a state file", path);
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(p == MAP_FAILED) {
+        LOGE("could not map %s: %s", path, strerror(errno));
+        return false;
+    }
+    map = p;
+    size = st.st_size;
+
+    const StateFileHeader &hdr = header();
+    // The bounds keep the expected size from overflowing.
+    bool ok = hdr.magic == STATE_FILE_MAGIC && hdr.version == STATE_FILE_VERSION &&
+        hdr.n > 0 && hdr.n <= 16 && hdr.w > 0 && hdr.w <= 65536 && hdr.h > 0 &&
+        hdr.h <= 65536 && hdr.num_params >= 0 && hdr.num_params <= STATE_FILE_MAX_PARAMS;
+    ok = ok && size == sizeof(StateFileHeader) +
+        (uint64_t)hdr.n * hdr.w * hdr.h * sizeof(float);
+    if(!ok) {
+        LOGE("%s is not a state file of this version", path);
+        close();
+        return false;
+    }
+    return true;
+}
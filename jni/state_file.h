@@ -0,0 +1,66 @@
+#ifndef STATE_FILE_H
+#define STATE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Checkpoints of the simulation state (see rdn_save_state).  A file is a StateFileHeader
+// followed by the state as n unpadded float planes of w*h, the layout of rdn_get_state(),
+// all in native byte order.  A file written on a machine of the other byte order fails
+// the magic check, as does anything else that isn't a state file.
+
+#define STATE_FILE_MAGIC 0x4e445253 // "SRDN" on little endian machines
+// Bumped whenever the layout of the header or of the planes changes.
+#define STATE_FILE_VERSION 1
+#define STATE_FILE_MAX_PARAMS 16
+
+struct StateFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // The model (index into the function list) and the params it had.
+    int32_t fn_idx;
+    int32_t num_params;
+    float params[STATE_FILE_MAX_PARAMS];
+    // Number of components, and grid size.
+    int32_t n;
+    int32_t w, h;
+};
+
+// Number of floats of state following the header.
+static inline size_t state_file_data_len(const StateFileHeader &hdr) {
+    return (size_t)hdr.n * hdr.w * hdr.h;
+}
+
+// Writes hdr (magic and version are filled in) and the state to path, replacing the file
+// atomically: the data goes to a temporary file next to it, which is synced and then
+// renamed over path, so a reader sees either the old file or the whole new one.  Returns
+// false, having logged why, on failure.
+bool write_state_file(const char *path, StateFileHeader hdr, const float *data);
+
+// A state file mapped read-only.  data() points straight into the mapping, so loading
+// costs no more than touching the pages that are used.
+class StateFile {
+public:
+    StateFile();
+    ~StateFile();
+
+    // Maps path and checks the header, and that the file is as long as it says.  Returns
+    // false, having logged why unless there is no such file, on failure.
+    bool open(const char *path);
+
+    const StateFileHeader &header() const { return *(const StateFileHeader *)map; }
+    const float *data() const {
+        return (const float *)((const uint8_t *)map + sizeof(StateFileHeader));
+    }
+
+private:
+    StateFile(const StateFile &);
+    StateFile &operator=(const StateFile &);
+
+    void close();
+
+    void *map;
+    size_t size;
+};
+
+#endif // STATE_FILE_H
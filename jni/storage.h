@@ -0,0 +1,160 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+// Conversions between rows of floats and the 16 bit state formats (see
+// rdn_set_storage_format).  All arithmetic is still done in float; these only run when rows
+// are loaded into or stored from the float buffers the kernels work on.
+//
+// The results of a step are rounded stochastically rather than to nearest: up with a
+// probability equal to the fraction of a step of the format that was dropped.  A model
+// relaxing slowly changes a value by less than half a step per step near the end, which
+// rounding to nearest would throw away every time, stalling it short of where it is
+// going.  Stochastic rounding keeps the expected value, so such changes still add up.
+
+// Noise for stochastic rounding: a fixed table of random words, which a row reads from an
+// offset given by its seed.  Reading a table keeps the encoding loops vectorizable.
+#define ROUND_NOISE_LEN 4096
+
+struct RoundNoise {
+    uint32_t v[ROUND_NOISE_LEN];
+
+    RoundNoise() {
+        uint32_t r = 0x9e3779b9;
+        for(int i=0; i<ROUND_NOISE_LEN; i++) {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            v[i] = r;
+        }
+    }
+};
+
+static inline const uint32_t *round_noise_table() {
+    static const RoundNoise table;
+    return table.v;
+}
+
+static inline int round_noise_offset(uint32_t seed) {
+    seed ^= seed >> 16;
+    seed *= 0x85ebca6b;
+    seed ^= seed >> 13;
+    return seed & (ROUND_NOISE_LEN - 1);
+}
+
+// IEEE half precision.  Values below the smallest normal half are flushed to zero, like
+// the float arithmetic (FlushToZero); overflow goes to infinity and NaN stays NaN.
+// Rounds to nearest even, or stochastically if noise (0..0x1fff, the 13 bits that are
+// dropped) is given.
+static inline uint16_t float_to_half(float f, int32_t noise = -1) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t mag = x & 0x7fffffff;
+    if(mag >= 0x7f800000) return sign | 0x7c00 | (mag > 0x7f800000 ? 0x200 : 0);
+    if(mag < 0x38800000) return sign;
+    // Rebias the exponent from 127 to 15 and round on the 13 bits that are dropped.  A
+    // carry out of the mantissa correctly bumps the exponent.
+    mag -= (127 - 15) << 23;
+    mag += noise < 0 ? 0xfff + ((mag >> 13) & 1) : noise;
+    if(mag >= 31u << 23) return sign | 0x7c00;
+    return sign | (mag >> 13);
+}
+
+static inline float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t mag = h & 0x7fff;
+    uint32_t x;
+    if(mag >= 0x7c00) {
+        x = sign | 0x7f800000 | ((mag & 0x3ff) << 13);
+    } else if(mag < 0x0400) {
+        // Zero.  Subnormals are never written by float_to_half.
+        x = sign;
+    } else {
+        x = sign | ((mag << 13) + ((127 - 15) << 23));
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+// Signed 16 bit fixed point: v is stored as round((v - offset) * scale), saturated to
+// +-32767.  -32768 is reserved for NaN so that a blown up simulation is still noticed.
+// Rounds to nearest, or stochastically if noise (uniform in [0,1)) is given.
+#define FIXED_NAN 0x8000
+
+static inline uint16_t float_to_fixed(float v, float offset, float scale,
+    float noise = -1
+) {
+    float q = (v - offset) * scale;
+    if(q != q) return FIXED_NAN;
+    if(q < -32767.0f) q = -32767.0f;
+    if(q >  32767.0f) q =  32767.0f;
+    // Shifted to be positive, so that truncating floors.
+    if(noise >= 0) return (uint16_t)(int16_t)((int)(q + 32768.0f + noise) - 32768);
+    return (uint16_t)(int16_t)(int)(q + (q < 0 ? -0.5f : 0.5f));
+}
+
+static inline float fixed_to_float(uint16_t q, float offset, float inv_scale) {
+    if(q == FIXED_NAN) return NAN;
+    return (int16_t)q * inv_scale + offset;
+}
+
+static inline void encode_half_row(const float *src, uint16_t *dst, int w) {
+    for(int x=0; x<w; x++) dst[x] = float_to_half(src[x]);
+}
+
+static inline void encode_half_row_stochastic(const float *src, uint16_t *dst, int w,
+    uint32_t seed
+) {
+    const uint32_t *table = round_noise_table();
+    int off = round_noise_offset(seed);
+    for(int x0=0; x0<w; ) {
+        // A run of the table up to where it wraps.
+        int len = std::min(w - x0, ROUND_NOISE_LEN - off);
+        const uint32_t *noise = table + off - x0;
+        for(int x=x0; x<x0+len; x++) dst[x] = float_to_half(src[x], noise[x] >> 19);
+        x0 += len;
+        off = 0;
+    }
+}
+
+static inline void decode_half_row(const uint16_t *src, float *dst, int w) {
+    for(int x=0; x<w; x++) dst[x] = half_to_float(src[x]);
+}
+
+static inline void encode_fixed_row(const float *src, uint16_t *dst, int w,
+    float offset, float scale
+) {
+    for(int x=0; x<w; x++) dst[x] = float_to_fixed(src[x], offset, scale);
+}
+
+static inline void encode_fixed_row_stochastic(const float *src, uint16_t *dst, int w,
+    float offset, float scale, uint32_t seed
+) {
+    const uint32_t *table = round_noise_table();
+    int off = round_noise_offset(seed);
+    for(int x0=0; x0<w; ) {
+        int len = std::min(w - x0, ROUND_NOISE_LEN - off);
+        const uint32_t *noise = table + off - x0;
+        for(int x=x0; x<x0+len; x++) {
+            dst[x] = float_to_fixed(src[x], offset, scale,
+                (noise[x] >> 8) * (1.0f / (1 << 24)));
+        }
+        x0 += len;
+        off = 0;
+    }
+}
+
+static inline void decode_fixed_row(const uint16_t *src, float *dst, int w,
+    float offset, float inv_scale
+) {
+    for(int x=0; x<w; x++) dst[x] = fixed_to_float(src[x], offset, inv_scale);
+}
+
+#endif // STORAGE_H
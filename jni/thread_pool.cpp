@@ -0,0 +1,156 @@
+#include <sched.h>
+
+#include "rdn_log.h"
+#include "thread_pool.h"
+
+// How many times a thread polls at a barrier before going to sleep.  Phases are short
+// (a fraction of a millisecond) so spinning a bit avoids most of the futex round trips.
+#define BARRIER_SPINS 4000
+
+struct WorkerArg {
+    ThreadPool *pool;
+    int idx;
+    // The job generation when the worker was created.  A worker that is slow to start must
+    // not mistake a job posted in the meantime for one it has already run.
+    int generation;
+};
+
+ThreadPool::ThreadPool() :
+    num_threads(1),
+    job(NULL),
+    job_generation(0),
+    jobs_pending(0),
+    quit(false),
+    barrier_count(0),
+    barrier_generation(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&work_cond, NULL);
+    pthread_cond_init(&done_cond, NULL);
+    pthread_cond_init(&barrier_cond, NULL);
+}
+
+ThreadPool::~ThreadPool() {
+    stop_workers();
+    pthread_cond_destroy(&barrier_cond);
+    pthread_cond_destroy(&done_cond);
+    pthread_cond_destroy(&work_cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+void ThreadPool::set_num_threads(int n) {
+    if(n < 1) n = 1;
+    if(n == num_threads) return;
+
+    stop_workers();
+
+    num_threads = n;
+    for(int i=1; i<n; i++) {
+        WorkerArg *arg = new WorkerArg;
+        arg->pool = this;
+        arg->idx = i;
+        arg->generation = job_generation;
+        pthread_t th;
+        if(pthread_create(&th, NULL, worker_main, arg)) {
+            LOGE("could not start worker thread %d", i);
+            delete(arg);
+            num_threads = i;
+            break;
+        }
+        workers.push_back(th);
+    }
+}
+
+void ThreadPool::stop_workers() {
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&mutex);
+
+    for(size_t i=0; i<workers.size(); i++) {
+        pthread_join(workers[i], NULL);
+    }
+    workers.clear();
+
+    quit = false;
+    num_threads = 1;
+}
+
+void *ThreadPool::worker_main(void *arg_in) {
+    WorkerArg *arg = (WorkerArg *)arg_in;
+    arg->pool->worker_loop(arg->idx, arg->generation);
+    delete(arg);
+    return NULL;
+}
+
+void ThreadPool::worker_loop(int idx, int seen_generation) {
+    pthread_mutex_lock(&mutex);
+    for(;;) {
+        while(!quit && job_generation == seen_generation) {
+            pthread_cond_wait(&work_cond, &mutex);
+        }
+        if(quit) break;
+        seen_generation = job_generation;
+        Job *j = job;
+        pthread_mutex_unlock(&mutex);
+
+        j->run(idx, num_threads);
+
+        pthread_mutex_lock(&mutex);
+        if(--jobs_pending == 0) {
+            pthread_cond_signal(&done_cond);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void ThreadPool::run(Job &j) {
+    if(num_threads == 1) {
+        j.run(0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+    job = &j;
+    jobs_pending = num_threads - 1;
+    job_generation++;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&mutex);
+
+    j.run(0, num_threads);
+
+    pthread_mutex_lock(&mutex);
+    while(jobs_pending > 0) {
+        pthread_cond_wait(&done_cond, &mutex);
+    }
+    job = NULL;
+    pthread_mutex_unlock(&mutex);
+}
+
+void ThreadPool::barrier() {
+    if(num_threads == 1) return;
+
+    int gen = __sync_fetch_and_add(&barrier_generation, 0);
+    if(__sync_add_and_fetch(&barrier_count, 1) == num_threads) {
+        barrier_count = 0;
+        __sync_fetch_and_add(&barrier_generation, 1);
+        pthread_mutex_lock(&mutex);
+        pthread_cond_broadcast(&barrier_cond);
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+
+    for(int i=0; i<BARRIER_SPINS; i++) {
+        if(barrier_generation != gen) {
+            __sync_synchronize();
+            return;
+        }
+        if((i & 255) == 255) sched_yield();
+    }
+
+    pthread_mutex_lock(&mutex);
+    while(barrier_generation == gen) {
+        pthread_cond_wait(&barrier_cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
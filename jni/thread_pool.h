@@ -0,0 +1,62 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+#include <vector>
+
+// A persistent pool of worker threads.  run() executes a job on every thread (the calling
+// thread takes index 0) and returns once all of them are done.  Jobs are expected to split
+// their work by index, typically into row bands, and can synchronize between phases with
+// barrier().
+class ThreadPool {
+public:
+    struct Job {
+        virtual ~Job() { }
+        virtual void run(int idx, int count) = 0;
+    };
+
+    ThreadPool();
+    ~ThreadPool();
+
+    // Total number of threads, including the caller of run().
+    void set_num_threads(int n);
+    int get_num_threads() const { return num_threads; }
+
+    void run(Job &job);
+
+    // Blocks until all threads of the current job have reached the barrier.  Must only be
+    // called from within Job::run, and by every thread the same number of times.
+    void barrier();
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    static void *worker_main(void *arg);
+    void worker_loop(int idx, int seen_generation);
+    void stop_workers();
+
+    int num_threads;
+    std::vector<pthread_t> workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    pthread_cond_t barrier_cond;
+
+    Job *job;
+    int job_generation;
+    int jobs_pending;
+    bool quit;
+
+    volatile int barrier_count;
+    volatile int barrier_generation;
+};
+
+// Splits [0,len) into count nearly equal bands and returns the start of band idx.
+inline int band_start(int len, int idx, int count) {
+    return (int)((long long)len * idx / count);
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,57 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+// Hands the latest of a stream of values from one writer thread to one reader thread
+// without either of them ever waiting for the other.  There are three slots: the writer
+// fills its back slot and publish()es it, the reader reads its front slot, and the third
+// one holds whatever was published last.  Both sides only swap their slot with the middle
+// one, so neither ever sees a slot the other is using.  Publishing faster than the reader
+// picks things up simply drops the values in between.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back(0), front(2), middle(1) { }
+
+    // Writer side.
+    T &write_slot() { return slots[back]; }
+
+    void publish() {
+        back = exchange(back | FRESH) & INDEX;
+    }
+
+    // Reader side.  update() switches the reader's slot to the last published one, if
+    // there is a new one, and returns whether it did.
+    T &read_slot() { return slots[front]; }
+
+    bool update() {
+        if(!(__sync_fetch_and_add(&middle, 0) & FRESH)) return false;
+        front = exchange(front) & INDEX;
+        return true;
+    }
+
+    // For setup and teardown, while neither side is active.
+    T &slot(int i) { return slots[i]; }
+
+private:
+    TripleBuffer(const TripleBuffer &);
+    TripleBuffer &operator=(const TripleBuffer &);
+
+    enum { INDEX = 3, FRESH = 4 };
+
+    // Swaps v into middle, with a full barrier, so the contents of a slot are visible
+    // before its index is.
+    int exchange(int v) {
+        int old;
+        do {
+            old = __sync_fetch_and_add(&middle, 0);
+        } while(!__sync_bool_compare_and_swap(&middle, old, v));
+        return old;
+    }
+
+    T slots[3];
+    int back, front;
+    // Index of the middle slot, with FRESH set if it was published and not yet read.
+    volatile int middle;
+};
+
+#endif // TRIPLE_BUFFER_H
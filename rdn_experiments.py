@@ -1,7 +1,8 @@
 #!/usr/bin/python
 
 # This can be used to prototype before writing a reaction-diffusion system up in C.
-# For some reason it's really slow.
+# For some reason it's really slow.  To explore the parameters of a model that is
+# already in the engine, use host/rdn_sweep instead.
 
 import numpy as np
 import numpy.random as random
@@ -33,11 +33,94 @@ class RdnRenderer implements
 {
     // jni methods
     public static native void evolve();
+    // Runs evolve() on a native thread at the given rate, so that onDrawFrame only renders.
+    public static native void startSimulation(float steps_per_second);
+    public static native void stopSimulation();
+    // Stops the simulation and frees most of its memory until the next frame or
+    // startSimulation().
+    public static native void suspend();
+    // State files, so that the pattern survives the process being killed.  loadState()
+    // only takes a file saved with the current model and params.
+    public static native boolean saveState(String path);
+    public static native boolean loadState(String path);
+    // Save the state to path every interval seconds while running, and on suspend().
+    public static native void setCheckpoint(String path, float interval);
+    // Fast-forward by sim_time of model time, for at most max_seconds; returns the time
+    // covered.  setWarmUp() has this done after every reset of the grid.
+    public static native float warmUp(float sim_time, float max_seconds);
+    public static native void setWarmUp(float sim_time, float max_seconds);
+    // format is one of the PIXEL_* constants.
     public static native void renderFrame(ByteBuffer bitmap, int w, int h, int offset,
-            int dir, float acc_x, float acc_y, float acc_z);
+            int dir, int format, float acc_x, float acc_y, float acc_z);
     public static native void setParams(int fn_idx, float[] params, int pal_idx);
     public static native void setColorMatrix(float[] cm);
     public static native void resetGrid();
+    public static native void setNumThreads(int num_threads);
+    // One of the DIFFUSION_* constants.
+    public static native void setDiffusionSolver(int fn_idx, int solver);
+    // Error tolerance for adaptive time stepping, or 0 for the fixed step.
+    public static native void setTimeTolerance(int fn_idx, float tol);
+    // One of the TOPOLOGY_* constants.
+    public static native void setTopology(int topology);
+    // One of the LAPLACIAN_* constants.
+    public static native void setLaplacian(int stencil);
+    // One of the STORAGE_* constants.
+    public static native void setStorageFormat(int format);
+    // Change thresholds below which evolve() backs off and the grid is reset (0 = never).
+    public static native void setSteadyState(float throttle, float reset);
+    // Skip the parts of the grid that are within eps of the blank medium (0 = never).
+    public static native void setSparseThreshold(float eps);
+    // RMS change of the state over the last step.
+    public static native float getChangeRate();
+    // Timings of the native phases: STATS_FIELDS values for each PHASE_* (indexed by the
+    // STAT_* offsets), followed by the grid width and height and the number of tiles the
+    // last step updated, out of the total.
+    public static native float[] getStats();
+    // How long the renderFrame calls of a frame took, for PHASE_JNI.
+    public static native void recordJniTime(float ms);
+
+    // Must match RdnPhase in jni/rdn_engine.h.
+    public static final int PHASE_STEP      = 0;
+    public static final int PHASE_DIFFUSION = 1;
+    public static final int PHASE_REACTION  = 2;
+    public static final int PHASE_RENDER    = 3;
+    public static final int PHASE_GRADIENT  = 4;
+    public static final int PHASE_JNI       = 5;
+    public static final int NUM_PHASES      = 6;
+    private static final String[] PHASE_NAMES = {
+        "step", "diffusion", "reaction", "render", "gradient", "jni"
+    };
+
+    // Layout of getStats(); must match rdnlib.cpp.
+    public static final int STAT_MEAN_MS = 0;
+    public static final int STAT_P95_MS  = 1;
+    public static final int STAT_MAX_MS  = 2;
+    public static final int STAT_BYTES   = 3;
+    public static final int STAT_SAMPLES = 4;
+    public static final int STATS_FIELDS = 5;
+
+    // Must match RdnDiffusionSolver in jni/rdn_engine.h.
+    public static final int DIFFUSION_EXPLICIT = 0;
+    public static final int DIFFUSION_IMPLICIT = 1;
+
+    // Must match RdnTopology in jni/rdn_engine.h.
+    public static final int TOPOLOGY_KLEIN   = 0;
+    public static final int TOPOLOGY_TORUS   = 1;
+    public static final int TOPOLOGY_NEUMANN = 2;
+
+    // Must match RdnLaplacian in jni/rdn_engine.h.
+    public static final int LAPLACIAN_5_POINT = 0;
+    public static final int LAPLACIAN_9_POINT = 1;
+
+    // Must match RdnStorageFormat in jni/rdn_engine.h.
+    public static final int STORAGE_FLOAT = 0;
+    public static final int STORAGE_FP16  = 1;
+    public static final int STORAGE_INT16 = 2;
+
+    // Must match RdnPixelFormat in jni/rdn_engine.h.
+    public static final int PIXEL_RGB24    = 0;
+    public static final int PIXEL_RGBA8888 = 1;
+    public static final int PIXEL_RGB565   = 2;
 
     static {
         System.loadLibrary("rdnlib");
@@ -45,7 +128,29 @@ class RdnRenderer implements
 
     private static final String TAG = RdnWallpaper.TAG;
     private static final boolean DEBUG = RdnWallpaper.DEBUG;
-    private static final int bpp = 3;
+    // RGBA8888 uploads through the fast path of most drivers; PIXEL_RGB565 halves the
+    // bandwidth again at the cost of dithering.
+    private static final int pixelFormat = PIXEL_RGBA8888;
+    private static final int bpp =
+        pixelFormat == PIXEL_RGBA8888 ? 4 : pixelFormat == PIXEL_RGB565 ? 2 : 3;
+    // A pattern changing by less than this per step looks frozen: one step moves the
+    // palettes by well under a color level.  Active patterns change by around 1e-2.
+    private static final float STEADY_THROTTLE = 1e-4f;
+    private static final float STEADY_RESET = 5e-5f;
+    // Well below a color level, so the skipped parts of the grid look the same.
+    private static final float SPARSE_THRESHOLD = 1e-4f;
+    // Steps per second of the simulation thread.  This used to be one step per frame.
+    private static final float SIM_RATE = 30f;
+    // Seconds between checkpoints of the state while visible.  It is also saved whenever
+    // the wallpaper is hidden, which is when the process tends to get killed.
+    private static final float CHECKPOINT_INTERVAL = 60f;
+    private static final String STATE_FILE = "state.bin";
+    // Model time to skip after a reset, indexed by fn_idx: about 200 steps at each model's
+    // time step, by which the seeds have grown into a pattern.  The simulation thread does
+    // it, so rendering carries on meanwhile, but it is cut short after WARM_UP_BUDGET
+    // seconds on slow devices.
+    private static final float[] WARM_UP_TIME = { 100f, 1500f, 50f, 1000f };
+    private static final float WARM_UP_BUDGET = 0.5f;
 
     private Context mContext;
     private int mRes = 4;
@@ -68,8 +173,8 @@ class RdnRenderer implements
     private ByteBuffer mPixelBuffer;
     private int mTextureId = -1;
 
-    private float[] mProfileAccum = new float[4];
-    private float[] mProfileTimes = new float[4];
+    private float[] mProfileAccum = new float[3];
+    private float[] mProfileTimes = new float[3];
     private int mProfileTicks = 0;
 
     private AccelerometerReader mAccelerometer;
@@ -113,8 +218,20 @@ class RdnRenderer implements
         mPrefs = PreferenceManager.getDefaultSharedPreferences(context);
         mPrefs.registerOnSharedPreferenceChangeListener(this);
 
+        mDrawLock.lock(); try {
+            setNumThreads(Runtime.getRuntime().availableProcessors());
+            setSteadyState(STEADY_THROTTLE, STEADY_RESET);
+            setSparseThreshold(SPARSE_THRESHOLD);
+        } finally { mDrawLock.unlock(); }
+
         setParamsToPrefs();
 
+        mDrawLock.lock(); try {
+            String path = context.getFilesDir() + "/" + STATE_FILE;
+            setCheckpoint(path, CHECKPOINT_INTERVAL);
+            if(loadState(path) && DEBUG) Log.i(TAG, "resuming from "+path);
+        } finally { mDrawLock.unlock(); }
+
         onVisibilityChanged(false);
     }
 
@@ -130,11 +247,27 @@ class RdnRenderer implements
         } else {
             mAccelerometer.onPause();
         }
+        mDrawLock.lock(); try {
+            if(visible) {
+                startSimulation(SIM_RATE);
+            } else {
+                suspend();
+            }
+        } finally { mDrawLock.unlock(); }
     }
 
     public void onSurfaceCreated(GL10 gl, EGLConfig config) {
     }
 
+    private static int texFormat() {
+        return pixelFormat == PIXEL_RGBA8888 ? GL11.GL_RGBA : GL11.GL_RGB;
+    }
+
+    private static int texType() {
+        return pixelFormat == PIXEL_RGB565 ?
+            GL11.GL_UNSIGNED_SHORT_5_6_5 : GL11.GL_UNSIGNED_BYTE;
+    }
+
     public void onDrawFrame(GL10 gl10) {
         mDrawLock.lock(); try {
             onDrawFrame_inner(gl10);
@@ -169,39 +302,38 @@ class RdnRenderer implements
             gl.glTexParameterf(GL10.GL_TEXTURE_2D, GL10.GL_TEXTURE_WRAP_S, GL10.GL_CLAMP_TO_EDGE);
             gl.glTexParameterf(GL10.GL_TEXTURE_2D, GL10.GL_TEXTURE_WRAP_T, GL10.GL_CLAMP_TO_EDGE);
 
-            gl.glTexImage2D(GL11.GL_TEXTURE_2D, 0, GL11.GL_RGB, mTexW, mTexH,
-                    0, GL11.GL_RGB, GL11.GL_UNSIGNED_BYTE, null);
+            gl.glTexImage2D(GL11.GL_TEXTURE_2D, 0, texFormat(), mTexW, mTexH,
+                    0, texFormat(), texType(), null);
 
             mOldTexW = mTexW;
             mOldTexH = mTexH;
         }
 
+        // The simulation thread steps on its own; this only draws its latest state.
         long t1 = SystemClock.uptimeMillis();
-
-        evolve();
-
-        long t2 = SystemClock.uptimeMillis();
+        long t1ns = System.nanoTime();
 
         if(mRepeatY > 1) {
-            renderFrame(mPixelBuffer, mGridW, mGridH/2, 0, 0,
+            renderFrame(mPixelBuffer, mGridW, mGridH/2, 0, 0, pixelFormat,
                     mAccelerometer.mVal[0],
                     mAccelerometer.mVal[1],
                     mAccelerometer.mVal[2]);
         }
 
-        renderFrame(mPixelBuffer, mGridW, mGridH/2, mGridW*(mGridH/2)*bpp, 1,
+        renderFrame(mPixelBuffer, mGridW, mGridH/2, mGridW*(mGridH/2)*bpp, 1, pixelFormat,
                 mAccelerometer.mVal[0],
                 mAccelerometer.mVal[1],
                 mAccelerometer.mVal[2]);
 
-        long t3 = SystemClock.uptimeMillis();
+        recordJniTime((System.nanoTime() - t1ns) * 1e-6f);
+        long t2 = SystemClock.uptimeMillis();
 
         gl.glClearColorx(0, 0, 0, 0);
         gl.glClear(GL11.GL_COLOR_BUFFER_BIT);
 
         gl.glBindTexture(GL11.GL_TEXTURE_2D, mTextureId);
         gl.glTexSubImage2D(GL11.GL_TEXTURE_2D, 0, 0, 0, mGridW, mGridH,
-                           GL11.GL_RGB, GL11.GL_UNSIGNED_BYTE, mPixelBuffer);
+                           texFormat(), texType(), mPixelBuffer);
 
         for(int x=0; x<mRepeatX; x++)
         for(int y=0; y<(mRepeatY+1)/2; y++) {
@@ -248,8 +380,7 @@ class RdnRenderer implements
 
         mProfileAccum[0] += gap;
         mProfileAccum[1] += t2-t1;
-        mProfileAccum[2] += t3-t2;
-        mProfileAccum[3] += tf-t2;
+        mProfileAccum[2] += tf-t1;
         mProfileTicks++;
 
         if(mProfileTicks == 10) {
@@ -262,18 +393,34 @@ class RdnRenderer implements
             if(DEBUG) {
                 Log.i(TAG,
                     "gap=" +mProfileTimes[0]+
-                    ", calc="+mProfileTimes[1]+
-                    ", rend="+mProfileTimes[2]+
-                    ", draw="+mProfileTimes[3]+
+                    ", rend="+mProfileTimes[1]+
+                    ", draw="+mProfileTimes[2]+
+                    ", change="+getChangeRate()+
                     ", size="+mGridW+","+mGridH+
                     ", tex="+mTexW+","+mTexH+
                     ", acc="+mAccelerometer.mVal[0]+","+mAccelerometer.mVal[1]+","+mAccelerometer.mVal[2]);
+                logStats();
             }
         }
 
         Thread.yield();
     }
 
+    // One line per native phase: mean/p95/max milliseconds and MB touched per sample.
+    private void logStats() {
+        float[] s = getStats();
+        if(s == null) return;
+        for(int i=0; i<NUM_PHASES; i++) {
+            int o = i*STATS_FIELDS;
+            if(s[o+STAT_SAMPLES] == 0) continue;
+            Log.i(TAG, String.format("%-9s mean=%.2f p95=%.2f max=%.2f ms, %.1f MB",
+                    PHASE_NAMES[i], s[o+STAT_MEAN_MS], s[o+STAT_P95_MS], s[o+STAT_MAX_MS],
+                    s[o+STAT_BYTES] * 1e-6f));
+        }
+        int tiles = NUM_PHASES*STATS_FIELDS + 2;
+        Log.i(TAG, "active tiles: "+(int)s[tiles]+" of "+(int)s[tiles+1]);
+    }
+
     public void onSurfaceChanged(GL10 gl10, int width, int height) {
         mDrawLock.lock(); try {
             onSurfaceChanged_inner(gl10, width, height);
@@ -372,6 +519,9 @@ class RdnRenderer implements
         mDrawLock.lock(); try {
             setParams(fn_idx, p_arr, pal);
             setColorMatrix(cm.getArray());
+            if(fn_idx >= 0 && fn_idx < WARM_UP_TIME.length) {
+                setWarmUp(WARM_UP_TIME[fn_idx], WARM_UP_BUDGET);
+            }
         } finally { mDrawLock.unlock(); }
 
         int newRes =